@@ -25,49 +25,107 @@
 static float constexpr kArptLimit = 18000;    // m, ~10 nm
 static float constexpr kMecSlope = 0.087f;    // 5° slope towards MEC
 
+// -> hit terrain, the probe only hits where scenery is loaded
+static bool ProbeElevation(Airport& arpt) {
+    double x, y, z;
+    const LLPos& pos = arpt.runways[0].end1;
+    XPLMWorldToLocal(pos.lat, pos.lon, 0, &x, &y, &z);
+    if (xplm_ProbeHitTerrain != XPLMProbeTerrainXYZ(probe_ref, x, y, z, &probeinfo))
+        return false;
+
+    double dummy, elev;
+    XPLMLocalToWorld(probeinfo.locationX, probeinfo.locationY, probeinfo.locationZ, &dummy, &dummy, &elev);
+    arpt.elevation = elev;
+    LogMsg("elevation of '%s', %0.1f ft", arpt.name.c_str(), arpt.elevation / kF2M);
+    return true;
+}
+
+// Pre-probing
+//
+// Airports within kProbeRadius of the position are probed nearest first,
+// so the one we depart from or approach is ready before LegacyAirportSnowDepth() needs it.
+// The list is rebuilt when the aircraft moved more than kProbeRebuild.
+static float constexpr kProbeRadius = 100000;   // m, roughly what scenery is loaded around the aircraft
+static float constexpr kProbeRebuild = 30000;   // m
+
+static std::vector<int> probe_list;     // indices into airports, nearest last
+static LLPos probe_pos;
+static bool have_probe_list;
+
+bool ProbeAirports(float lon, float lat) {
+    LLPos pos = {lon, lat};
+
+    if (!have_probe_list || len(pos - probe_pos) > kProbeRebuild) {
+        have_probe_list = true;
+        probe_pos = pos;
+        airport_index.FindAll(pos, kProbeRadius, probe_list);
+        std::erase_if(probe_list, [](int i) { return airports[i]->elevation != Airport::kNoElevation; });
+        std::sort(probe_list.begin(), probe_list.end(), [&pos](int a, int b) {
+            return len(pos - airports[a]->mec_center) > len(pos - airports[b]->mec_center);
+        });
+
+        if (probe_list.size() > 0)
+            LogMsg("%d airports to probe", (int)probe_list.size());
+    }
+
+    // a probe can take a while when scenery is paged in, so only one per call
+    while (probe_list.size() > 0) {
+        Airport& arpt = *airports[probe_list.back()];
+        probe_list.pop_back();
+
+        // probed by LegacyAirportSnowDepth() meanwhile or not yet loaded, then it's retried after a rebuild
+        if (arpt.elevation == Airport::kNoElevation) {
+            ProbeElevation(arpt);
+            break;
+        }
+    }
+
+    return probe_list.size() > 0;
+}
+
 std::tuple<float, bool> LegacyAirportSnowDepth(float lon, float lat, float snow_depth)  // -> adjusted snow depth, in range of a legacy airport
 {
     // look whether we are approaching a legacy airport
     LLPos pos = {lon, lat};
 
-    for (auto& arpt : airports) {
-        float dist = len(pos - arpt->mec_center);
-        float max_snow_depth = std::min(arpt->max_snow_depth, 0.25f);   // max 25cm snow at legacy airports
-
-        if (dist < kArptLimit) {
-            if (snow_depth <= max_snow_depth)
-                return std::make_tuple(snow_depth, true);
-
-            if (arpt->elevation == Airport::kNoElevation) {
-                double x, y, z;
-                const LLPos& pos = arpt->runways[0].end1;
-                XPLMWorldToLocal(pos.lat, pos.lon, 0, &x, &y, &z);
-                if (xplm_ProbeHitTerrain != XPLMProbeTerrainXYZ(probe_ref, x, y, z, &probeinfo)) {
-                    LogMsg("terrain probe failed???");
-                }
-
-                double dummy, elev;
-                XPLMLocalToWorld(probeinfo.locationX, probeinfo.locationY, probeinfo.locationZ, &dummy, &dummy, &elev);
-                arpt->elevation = elev;
-                LogMsg("elevation of '%s', %0.1f ft", arpt->name.c_str(), arpt->elevation / kF2M);
-            }
+    int i = airport_index.FindFirst(pos, kArptLimit);
+    if (i < 0)
+        return std::make_tuple(snow_depth, false);
 
-            float haa = XPLMGetDataf(plane_elevation_dr) - arpt->elevation;
-            float ref_haa = dist * kMecSlope;          // slope from center
-            float dh = std::max(0.0f, haa - ref_haa);  // a delta above ref slope
-            float ref_dist = dist + 10.0f * dh;        // is weighted higher
+    auto& arpt = airports[i];
+    float dist = len(pos - arpt->mec_center);
+    float max_snow_depth = std::min(arpt->max_snow_depth, 0.25f);   // max 25cm snow at legacy airports
 
-            // now interpolate down to max_snow_depth at the MEC
-            float a = (ref_dist - arpt->mec_radius) / (kArptLimit - arpt->mec_radius);
-            a = std::max(0.0f, std::min(a, 1.0f));
-            a = std::pow(a, 1.5f);  // slightly progressive
-            float snow_depth_n = max_snow_depth + a * (std::min(snow_depth, 0.25f) - max_snow_depth);
+    if (snow_depth <= max_snow_depth)
+        return std::make_tuple(snow_depth, true);
 
-            //LogMsg("haa: %.0f, ref_haa: %0.f, dist to '%s', %.0f m, snow_depth in: %0.2f, out: %0.3f",
-            //        haa, ref_haa, arpt->name.c_str(), dist, snow_depth, snow_depth_n);
-            return std::make_tuple(snow_depth_n, true);
+    // usually done by ProbeAirports() or taken from the cache
+    float elevation = arpt->elevation;
+    if (elevation == Airport::kNoElevation) {
+        if (ProbeElevation(*arpt)) {
+            elevation = arpt->elevation;
+        } else {
+            // use the ground below us for now and try again next time
+            if (!arpt->probe_failed_logged) {
+                arpt->probe_failed_logged = true;
+                LogMsg("terrain probe for '%s' failed, using the ground below the aircraft", arpt->name.c_str());
+            }
+            elevation = XPLMGetDataf(plane_elevation_dr) - XPLMGetDataf(plane_y_agl_dr);
         }
     }
 
-    return std::make_tuple(snow_depth, false);
+    float haa = XPLMGetDataf(plane_elevation_dr) - elevation;
+    float ref_haa = dist * kMecSlope;          // slope from center
+    float dh = std::max(0.0f, haa - ref_haa);  // a delta above ref slope
+    float ref_dist = dist + 10.0f * dh;        // is weighted higher
+
+    // now interpolate down to max_snow_depth at the MEC
+    float a = (ref_dist - arpt->mec_radius) / (kArptLimit - arpt->mec_radius);
+    a = std::max(0.0f, std::min(a, 1.0f));
+    a = std::pow(a, 1.5f);  // slightly progressive
+    float snow_depth_n = max_snow_depth + a * (std::min(snow_depth, 0.25f) - max_snow_depth);
+
+    //LogMsg("haa: %.0f, ref_haa: %0.f, dist to '%s', %.0f m, snow_depth in: %0.2f, out: %0.3f",
+    //        haa, ref_haa, arpt->name.c_str(), dist, snow_depth, snow_depth_n);
+    return std::make_tuple(snow_depth_n, true);
 }
@@ -23,10 +23,12 @@
 #define _AIRPORT_H_
 
 #include <cmath>
+#include <algorithm>
 #include <string>
 #include <memory>
 #include <vector>
 #include <tuple>
+#include <unordered_map>
 
 #include "xa-snow.h"
 
@@ -90,6 +92,14 @@ static inline Vec2 operator*(float c, const Vec2& v) {
     return {c * v.x, c * v.y};
 }
 
+struct Circle {
+    Vec2 c;
+    float r;
+};
+
+// minimum enclosing circle, the order of points is changed
+extern Circle MinEnclosingCircle(std::vector<Vec2>& points);
+
 struct Runway {
     std::string name;
     LLPos end1, end2;
@@ -101,6 +111,7 @@ struct Airport {
 
 	std::string name;
     float elevation{kNoElevation};      // m MSL
+    bool probe_failed_logged{false};    // log a failing probe only once
     std::vector<Runway> runways;
 	float max_snow_depth;	// m, reduce to this min snow depth within the MEC
 
@@ -114,13 +125,54 @@ struct Airport {
 
 extern std::vector<std::unique_ptr<Airport>> airports;
 
+// Grid buckets over the MEC centers of airports, built once by CollectAirports()
+class AirportIndex {
+    static constexpr float kCell = 0.25f;               // ° lat and lon
+    static constexpr int kNLon = 360.0f / kCell;
+
+    const std::vector<std::unique_ptr<Airport>> *airports_{nullptr};
+    std::unordered_map<int, std::vector<int>> buckets_; // cell -> ascending indices into airports
+
+    static int LatCell(float lat) { return std::clamp((int)floorf((lat + 90.0f) / kCell), 0, (int)(180.0f / kCell) - 1); }
+    static int LonCell(float lon);
+
+    struct CellRange {
+        int j_lo, j_hi;     // lat cells
+        int i_lo, n_i;      // lon cells, may wrap around
+    };
+    static CellRange Range(const LLPos& pos, float radius);
+
+  public:
+    void Build(const std::vector<std::unique_ptr<Airport>>& airports);
+
+    // -> index of the first airport with len(pos - mec_center) < radius or -1
+    // same result as a linear scan over the airports in order
+    int FindFirst(const LLPos& pos, float radius) const;
+
+    // -> ascending indices of all airports with len(pos - mec_center) < radius
+    void FindAll(const LLPos& pos, float radius, std::vector<int>& result) const;
+};
+
+extern AirportIndex airport_index;
+
 struct SceneryPacks {
     std::vector<std::string> sc_paths;
     SceneryPacks(const std::string& xp_dir);
 };
 
+// -> the first airport in apt.dat, nullptr if the file can't be read
+extern std::unique_ptr<Airport> ParseAptDat(const std::string& fn);
+
 extern bool CollectAirports(const std::string& xp_dir);
 
+// write back elevations probed since CollectAirports() to the cache, if any
+extern bool SaveAirportsCache();
+
+// pre-probe the elevation of airports around the position, call from the flight loop
+// one airport is probed per call to not stall the sim
+// -> more airports are pending
+extern bool ProbeAirports(float lon, float lat);
+
 // -> adjusted snow depth, in range of a legacy airport
 extern std::tuple<float, bool> LegacyAirportSnowDepth(float lon, float lat, float snow_depth);
 
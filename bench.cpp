@@ -0,0 +1,1172 @@
+//
+//    X Airline Snow: show accumulated snow in X-Plane's world
+//
+//    Copyright (C) 2025  Holger Teutsch
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+// Micro benchmarks, usage: bench [name...]
+// Without arguments all benchmarks are run.
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <array>
+#include <tuple>
+#include <string>
+#include <fstream>
+#include <chrono>
+#include <random>
+#include <memory>
+#include <vector>
+#include <filesystem>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "xa-snow.h"
+#include "depth_map.h"
+#include "coast_map.h"
+#include "airport.h"
+#include "loop_stats.h"
+#include "dref_writer.h"
+
+#include <spng.h> // include after xa-snow.h
+
+const char *log_msg_prefix = "bench: ";
+
+std::string xp_dir;
+std::string plugin_dir;
+std::string output_dir;
+
+class Timer {
+    std::chrono::steady_clock::time_point start_{std::chrono::steady_clock::now()};
+
+  public:
+    double ms() const {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_).count();
+    }
+};
+
+// count last level cache misses of this thread, Linux only
+class CacheMisses {
+    int fd_{-1};
+
+  public:
+    CacheMisses() {
+#ifdef __linux__
+        perf_event_attr attr{};
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fd_ >= 0) {
+            ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    ~CacheMisses() {
+#ifdef __linux__
+        if (fd_ >= 0)
+            close(fd_);
+#endif
+    }
+
+    // -> # of misses so far or -1 if not available
+    long long count() const {
+        long long n = -1;
+#ifdef __linux__
+        if (fd_ < 0 || read(fd_, &n, sizeof(n)) != sizeof(n))
+            n = -1;
+#endif
+        return n;
+    }
+};
+
+//------------------------------------------------------------------------------------
+// DepthMap::LoadCSV vs. the former getline + sscanf loop
+//
+static void
+BenchLoadCSV()
+{
+    static constexpr float kRes = 0.25f;
+    static constexpr int kWidth = 1440, kHeight = 721;
+    const char *csv_name = "bench_snod.csv";
+
+    // synthetic full globe csv in wgrib2's format
+    {
+        std::mt19937 rng(4711);
+        std::uniform_real_distribution<float> sd(0.0f, 2.0f);
+        FILE *f = fopen(csv_name, "w");
+        fprintf(f, "longitude, latitude, value,\n");
+        for (int j = 0; j < kHeight; j++)
+            for (int i = 0; i < kWidth; i++)
+                fprintf(f, "%f, %f, %g,\n", i * kRes, j * kRes - 90.0f, sd(rng));
+        fclose(f);
+    }
+
+    // the former implementation
+    auto ref = std::make_unique<float[]>(kWidth * kHeight);
+    Timer t_ref;
+    {
+        std::ifstream file(csv_name);
+        std::string line;
+        std::getline(file, line);
+        while (std::getline(file, line)) {
+            float lat, lon, value;
+            if (3 != sscanf(line.c_str(), "%f,%f,%f", &lon, &lat, &value))
+                continue;
+
+            if (value < 0.001f)
+                continue;
+
+            int x = std::lroundf(lon / kRes);
+            int y = std::lroundf((lat + 90.0f) / kRes);
+            if (x < 0 || x >= kWidth || y < 0 || y >= kHeight)
+                continue;
+
+            ref[y * kWidth + x] = value;
+        }
+    }
+    double ms_ref = t_ref.ms();
+
+    // coast map is not loaded so no extension passes are run
+    DepthMap map(kRes);
+    Timer t_new;
+    map.LoadCSV(csv_name);
+    double ms_new = t_new.ms();
+
+    int n_diff = 0;
+    for (int j = 0; j < kHeight; j++)
+        for (int i = 0; i < kWidth; i++) {
+            auto [sd, is_extended] = map.Get(i * kRes, j * kRes - 90.0f);
+            if (sd != ref[j * kWidth + i])
+                n_diff++;
+        }
+
+    std::remove(csv_name);
+    LogMsg("load_csv: %d lines, getline + sscanf: %0.1f ms, LoadCSV: %0.1f ms, speedup: %0.1f, # of differing points: %d",
+           kWidth * kHeight, ms_ref, ms_new, ms_ref / ms_new, n_diff);
+}
+
+//------------------------------------------------------------------------------------
+// DepthMap::Get() with float + bool vs. compact storage
+//
+static void
+BenchCompact()
+{
+    const char *grib_file = "testdata/2023-12-03_12_noaa.grib2";
+    DepthMap map_float(0.25f), map_compact(0.25f);
+    if (!map_float.LoadGrib(grib_file) || !map_compact.LoadGrib(grib_file)) {
+        LogMsg("compact: can't load '%s'", grib_file);
+        return;
+    }
+    map_compact.Compact();
+
+    static constexpr int kN = 4 * 1024 * 1024;
+    std::mt19937 rng(4711);
+
+    // random positions all over the globe
+    std::vector<std::pair<float, float>> random_pos(kN);
+    std::uniform_real_distribution<float> lon_d(-180.0f, 180.0f), lat_d(-90.0f, 90.0f);
+    for (auto& p : random_pos)
+        p = {lon_d(rng), lat_d(rng)};
+
+    // a slowly turning trajectory with ~ 10 m between lookups
+    std::vector<std::pair<float, float>> traj_pos(kN);
+    std::uniform_real_distribution<float> turn_d(-0.001f, 0.001f);
+    float lon = 7.0f, lat = 45.0f, hdg = 1.0f;
+    for (auto& p : traj_pos) {
+        hdg += turn_d(rng);
+        lon += 1.0e-4f * std::cos(hdg);
+        lat += 1.0e-4f * std::sin(hdg);
+        if (lon > 180.0f)
+            lon -= 360.0f;
+        lat = std::clamp(lat, -89.0f, 89.0f);
+        p = {lon, lat};
+    }
+
+    float max_diff = 0.0f;
+    for (int i = 0; i < kN; i += 16) {
+        auto [sd_f, ext_f] = map_float.Get(random_pos[i].first, random_pos[i].second);
+        auto [sd_c, ext_c] = map_compact.Get(random_pos[i].first, random_pos[i].second);
+        max_diff = std::max(max_diff, std::abs(sd_f - sd_c));
+    }
+
+    LogMsg("compact: float: 5 bytes/grid point, compact: 2 bytes/grid point, max_diff: %0.5f m", max_diff);
+
+    auto run = [](const DepthMap& map, const std::vector<std::pair<float, float>>& pos, const char *what) {
+        float sum = 0.0f;
+        CacheMisses misses;
+        Timer t;
+        for (auto [lon, lat] : pos) {
+            auto [sd, ext] = map.Get(lon, lat);
+            sum += sd + ext;
+        }
+        double ms = t.ms();
+        long long n_misses = misses.count();
+        std::string misses_str = (n_misses >= 0) ? std::to_string(n_misses) : "n/a";
+        LogMsg("compact: %-20s %6.1f ns/lookup, cache misses: %s, (checksum %0.1f)",
+               what, ms * 1.0e6 / pos.size(), misses_str.c_str(), sum);
+    };
+
+    run(map_float, random_pos, "random float");
+    run(map_compact, random_pos, "random compact");
+    run(map_float, traj_pos, "trajectory float");
+    run(map_compact, traj_pos, "trajectory compact");
+}
+
+//------------------------------------------------------------------------------------
+// DepthMap::GetMany() vs. Get() for the snow_depth.png grid
+//
+static void
+BenchGetMany()
+{
+    const char *grib_file = "testdata/2023-12-03_12_noaa.grib2";
+    DepthMap map(0.25f);
+    if (!map.LoadGrib(grib_file)) {
+        LogMsg("get_many: can't load '%s'", grib_file);
+        return;
+    }
+
+    static constexpr int kWidth = 3600, kHeight = 1800;
+    auto lon = std::make_unique<float[]>(kWidth);
+    auto lat = std::make_unique<float[]>(kWidth);
+    auto sd = std::make_unique<float[]>(kWidth);
+    auto is_extended = std::make_unique<bool[]>(kWidth);
+    for (int i = 0; i < kWidth; i++)
+        lon[i] = i * 0.1f;
+
+    for (int compact = 0; compact < 2; compact++) {
+        if (compact)
+            map.Compact();
+
+        float sum = 0.0f;
+        Timer t_get;
+        for (int j = 0; j < kHeight; j++)
+            for (int i = 0; i < kWidth; i++) {
+                auto [sd, is_extended] = map.Get(lon[i], j * 0.1f - 90.0f);
+                sum += sd + is_extended;
+            }
+        double ms_get = t_get.ms();
+
+        float sum_many = 0.0f;
+        Timer t_many;
+        for (int j = 0; j < kHeight; j++) {
+            std::fill_n(lat.get(), kWidth, j * 0.1f - 90.0f);
+            map.GetMany(kWidth, lon.get(), lat.get(), sd.get(), is_extended.get());
+            for (int i = 0; i < kWidth; i++)
+                sum_many += sd[i] + is_extended[i];
+        }
+        double ms_many = t_many.ms();
+
+        LogMsg("get_many: %s, %d points, Get(): %0.1f ms, GetMany(): %0.1f ms, speedup: %0.1f, checksums: %s",
+               compact ? "compact" : "float", kWidth * kHeight, ms_get, ms_many, ms_get / ms_many,
+               sum == sum_many ? "equal" : "DIFFERENT");
+    }
+}
+
+//------------------------------------------------------------------------------------
+// DepthMap::Get() on the grid with halo vs. the former wrap around + clamping of every corner
+//
+namespace {
+struct UnpaddedMap {
+    float resolution;
+    int width, height;
+    std::unique_ptr<float[]> val;
+    std::unique_ptr<bool[]> extended_snow;
+
+    int MapIdx(int i_lon, int i_lat) const {
+        if (i_lon >= width)
+            i_lon -= width;
+        else if (i_lon < 0)
+            i_lon += width;
+
+        if (i_lat >= height)
+            i_lat = height - 1;
+        else if (i_lat < 0)
+            i_lat = 0;
+
+        return i_lat * width + i_lon;
+    }
+
+    std::tuple<float, bool> Get(float lon, float lat) const {
+        lat += 90.0;
+        if (lon < 0)
+            lon += 360;
+
+        lon /= resolution;
+        lat /= resolution;
+
+        int i_lon = lon;
+        int i_lat = lat;
+        float s = lon - i_lon;
+        float t = lat - i_lat;
+
+        int i00 = MapIdx(i_lon, i_lat);
+        int i10 = MapIdx(i_lon + 1, i_lat);
+        int i01 = MapIdx(i_lon, i_lat + 1);
+        int i11 = MapIdx(i_lon + 1, i_lat + 1);
+
+        float p00 = (1 - s) * (1 - t);
+        float p10 = s * (1 - t);
+        float p01 = (1 - s) * t;
+        float p11 = s * t;
+
+        float v = val[i00] * p00 + val[i10] * p10 + val[i01] * p01 + val[i11] * p11;
+        bool es = extended_snow[i00] || extended_snow[i10] || extended_snow[i01] || extended_snow[i11];
+        return std::tuple(v, es);
+    }
+};
+}
+
+static void
+BenchHalo()
+{
+    const char *grib_file = "testdata/2023-12-03_12_noaa.grib2";
+    static constexpr float kRes = 0.25f;
+    DepthMap map(kRes);
+    if (!map.LoadGrib(grib_file)) {
+        LogMsg("halo: can't load '%s'", grib_file);
+        return;
+    }
+
+    // sampling at the grid points yields the values without halo
+    UnpaddedMap ref{kRes, 1440, 721, std::make_unique<float[]>(1440 * 721), std::make_unique<bool[]>(1440 * 721)};
+    for (int j = 0; j < ref.height; j++)
+        for (int i = 0; i < ref.width; i++)
+            std::tie(ref.val[j * ref.width + i], ref.extended_snow[j * ref.width + i]) =
+                map.Get(i * kRes, j * kRes - 90.0f);
+
+    static constexpr int kN = 4 * 1024 * 1024;
+    std::mt19937 rng(4711);
+
+    std::vector<std::pair<float, float>> random_pos(kN);
+    std::uniform_real_distribution<float> lon_d(-180.0f, 180.0f), lat_d(-90.0f, 90.0f);
+    for (auto& p : random_pos)
+        p = {lon_d(rng), lat_d(rng)};
+
+    // great circle from Frankfurt over the pole to Los Angeles and further around the globe,
+    // passes the date line and both poles
+    std::vector<std::pair<float, float>> gc_pos(kN);
+    {
+        auto to_vec = [](double lon, double lat) {
+            lon *= M_PI / 180.0;
+            lat *= M_PI / 180.0;
+            return std::array<double, 3>{std::cos(lat) * std::cos(lon), std::cos(lat) * std::sin(lon),
+                                         std::sin(lat)};
+        };
+
+        auto a = to_vec(8.57, 50.03);
+        auto b = to_vec(-118.41, 33.94);
+
+        // orthonormal base of the great circle plane
+        double d = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+        std::array<double, 3> u{b[0] - d * a[0], b[1] - d * a[1], b[2] - d * a[2]};
+        double u_len = std::sqrt(u[0] * u[0] + u[1] * u[1] + u[2] * u[2]);
+        for (auto& c : u)
+            c /= u_len;
+
+        for (int i = 0; i < kN; i++) {
+            double phi = 2.0 * M_PI * i / kN;
+            double x = std::cos(phi) * a[0] + std::sin(phi) * u[0];
+            double y = std::cos(phi) * a[1] + std::sin(phi) * u[1];
+            double z = std::cos(phi) * a[2] + std::sin(phi) * u[2];
+            gc_pos[i] = {(float)(std::atan2(y, x) * 180.0 / M_PI),
+                         (float)(std::asin(std::clamp(z, -1.0, 1.0)) * 180.0 / M_PI)};
+        }
+    }
+
+    auto run = [](const auto& map, const std::vector<std::pair<float, float>>& pos, const char *what,
+                  std::vector<std::tuple<float, bool>>& res) {
+        res.resize(pos.size());
+        CacheMisses misses;
+        Timer t;
+        for (size_t i = 0; i < pos.size(); i++)
+            res[i] = map.Get(pos[i].first, pos[i].second);
+        double ms = t.ms();
+        long long n_misses = misses.count();
+        std::string misses_str = (n_misses >= 0) ? std::to_string(n_misses) : "n/a";
+        LogMsg("halo: %-22s %6.2f ns/lookup, cache misses: %s", what, ms * 1.0e6 / pos.size(), misses_str.c_str());
+    };
+
+    std::vector<std::tuple<float, bool>> res_ref, res_halo;
+    run(ref, random_pos, "random MapIdx", res_ref);
+    run(map, random_pos, "random halo", res_halo);
+    LogMsg("halo: random results: %s", res_ref == res_halo ? "identical" : "DIFFERENT");
+
+    run(ref, gc_pos, "great circle MapIdx", res_ref);
+    run(map, gc_pos, "great circle halo", res_halo);
+    LogMsg("halo: great circle results: %s", res_ref == res_halo ? "identical" : "DIFFERENT");
+}
+
+//------------------------------------------------------------------------------------
+// CoastMap lookups
+//
+static void
+BenchCoastMap()
+{
+    if (!coast_map.is_loaded() && !coast_map.load(".")) {
+        LogMsg("coast_map: can't load the coast map");
+        return;
+    }
+
+    LogMsg("coast_map: %d x %d, memory: %0.1f MB", coast_map.width_, coast_map.height_,
+           coast_map.mem_size() / (1024.0 * 1024.0));
+
+    static constexpr int kN = 4 * 1024 * 1024;
+    std::mt19937 rng(4711);
+
+    std::vector<std::pair<float, float>> random_pos(kN);
+    std::uniform_real_distribution<float> lon_d(-180.0f, 180.0f), lat_d(-85.0f, 85.0f);
+    for (auto& p : random_pos)
+        p = {lon_d(rng), lat_d(rng)};
+
+    // through the western Baltic sea, ~ 100 m between lookups
+    std::vector<std::pair<float, float>> coast_pos(kN);
+    for (int i = 0; i < kN; i++) {
+        float f = (float)(i % (kN / 8)) / (kN / 8);
+        coast_pos[i] = {9.5f + 4.5f * f, 54.0f + 1.5f * f};
+    }
+
+    auto run = [](const std::vector<std::pair<float, float>>& pos, const char *what, auto func) {
+        int sum = 0;
+        Timer t;
+        for (auto [lon, lat] : pos)
+            sum += func(lon, lat);
+        double ms = t.ms();
+        LogMsg("coast_map: %-20s %6.2f ns/lookup (checksum %d)", what, ms * 1.0e6 / pos.size(), sum);
+    };
+
+    auto is_water = [](float lon, float lat) { return (int)coast_map.is_water(lon, lat); };
+    auto is_coast = [](float lon, float lat) { return (int)std::get<0>(coast_map.is_coast(lon, lat)); };
+    auto nearest_land = [](float lon, float lat) { return (int)std::get<1>(coast_map.nearest_land(lon, lat)); };
+
+    run(random_pos, "random is_water", is_water);
+    run(random_pos, "random is_coast", is_coast);
+    run(random_pos, "random nearest_land", nearest_land);
+    run(coast_pos, "coast is_water", is_water);
+    run(coast_pos, "coast is_coast", is_coast);
+    run(coast_pos, "coast nearest_land", nearest_land);
+}
+
+//------------------------------------------------------------------------------------
+// CoastMap with tiles
+// There is no higher resolution dataset at hand so the tiles are upsampled from
+// the global map. Good enough for the timing, the lookups and the LRU.
+//
+static bool
+WriteTile(const std::string& dir, int lon_0, int lat_0, int n)
+{
+    std::vector<uint8_t> rgba(4 * n * n, 255);
+    for (int j = 0; j < n; j++)
+        for (int i = 0; i < n; i++) {
+            float lon = lon_0 + (i + 0.5f) / n;
+            float lat = lat_0 + 1.0f - (j + 0.5f) / n;     // (0,0) is top left
+            if (!coast_map.is_land(lon, lat))
+                memset(&rgba[4 * (j * n + i)], 0, 3);
+        }
+
+    spng_ctx *ctx = spng_ctx_new(SPNG_CTX_ENCODER);
+    spng_set_option(ctx, SPNG_ENCODE_TO_BUFFER, 1);
+    struct spng_ihdr ihdr = {};
+    ihdr.width = ihdr.height = n;
+    ihdr.bit_depth = 8;
+    ihdr.color_type = SPNG_COLOR_TYPE_TRUECOLOR_ALPHA;
+    spng_set_ihdr(ctx, &ihdr);
+
+    int ret = spng_encode_image(ctx, rgba.data(), rgba.size(), SPNG_FMT_PNG, SPNG_ENCODE_FINALIZE);
+    size_t len = 0;
+    void *png = ret ? nullptr : spng_get_png_buffer(ctx, &len, &ret);
+    spng_ctx_free(ctx);
+    if (png == nullptr)
+        return false;
+
+    char name[20];
+    snprintf(name, sizeof(name), "%+03d%+04d.png", lat_0, lon_0);
+    std::ofstream f(dir + "/" + name, std::ios::binary);
+    f.write((const char *)png, len);
+    free(png);
+    return f.good();
+}
+
+static void
+BenchCoastTiles()
+{
+    if (!coast_map.is_loaded() && !coast_map.load(".")) {
+        LogMsg("coast_tiles: can't load the coast map");
+        return;
+    }
+
+    // tiles around the western Baltic sea, 16 x the resolution of the global map
+    static constexpr int kTileN = 256;
+    std::string dir = "bench_tiles";
+    std::filesystem::create_directory(dir);
+    for (int lat_0 = 52; lat_0 < 58; lat_0++)
+        for (int lon_0 = 6; lon_0 < 17; lon_0++)
+            if (!WriteTile(dir, lon_0, lat_0, kTileN)) {
+                LogMsg("coast_tiles: can't write tiles");
+                return;
+            }
+
+    CoastMap tiled;
+    if (!tiled.load(".")) {
+        LogMsg("coast_tiles: can't load the coast map");
+        return;
+    }
+    tiled.tile_dir_ = dir;
+
+    // update and load until all tiles within the radius are there, -> # of loads
+    auto settle = [&tiled](float lon, float lat) {
+        int n = 0;
+        tiled.update_tiles(lon, lat);
+        while (tiled.tile_future_.valid()) {
+            n++;
+            tiled.wait_tiles();
+            tiled.update_tiles(lon, lat);
+        }
+        return n;
+    };
+
+    Timer t_load;
+    int n_loaded = settle(11.0f, 54.5f);
+    double ms = t_load.ms();
+    LogMsg("coast_tiles: %d tiles of %d x %d loaded, %0.1f ms per tile, memory: %0.1f MB", n_loaded, kTileN, kTileN,
+           ms / std::max(n_loaded, 1), tiled.tiles_mem_size() / (1024.0 * 1024.0));
+
+    static constexpr int kN = 4 * 1024 * 1024;
+    std::vector<std::pair<float, float>> coast_pos(kN);
+    for (int i = 0; i < kN; i++) {
+        float f = (float)(i % (kN / 8)) / (kN / 8);
+        coast_pos[i] = {9.5f + 4.5f * f, 54.0f + 1.5f * f};
+    }
+
+    auto run = [&coast_pos](const CoastMap& map, const char *what) {
+        int sum = 0;
+        Timer t;
+        for (auto [lon, lat] : coast_pos)
+            sum += std::get<1>(map.nearest_land(lon, lat));
+        double ms = t.ms();
+        LogMsg("coast_tiles: %-20s %6.2f ns/lookup (checksum %d)", what, ms * 1.0e6 / coast_pos.size(), sum);
+    };
+
+    run(coast_map, "global nearest_land");
+    run(tiled, "tiled nearest_land");
+
+    int n_agree = 0;
+    for (auto [lon, lat] : coast_pos)
+        n_agree += (coast_map.is_water(lon, lat) || std::get<0>(coast_map.is_coast(lon, lat)))
+                    == (tiled.is_water(lon, lat) || std::get<0>(tiled.is_coast(lon, lat)));
+    LogMsg("coast_tiles: water tiled vs. global agree for %0.2f %%", 100.0 * n_agree / coast_pos.size());
+
+    // fly the track with a budget of a few tiles
+    size_t tile_size = tiled.tiles_mem_size() / std::max(tiled.n_tiles(), 1);
+    tiled.tile_budget_ = 12 * tile_size;
+    tiled.tile_radius_ = 50.0e3f;
+    n_loaded = 0;
+    size_t max_mem = 0;
+    for (int k = 0; k < 64; k++) {
+        float f = (k < 32 ? k : 63 - k) / 31.0f;   // there and back again
+        n_loaded += settle(9.5f + 4.5f * f, 54.0f + 1.5f * f);
+        max_mem = std::max(max_mem, tiled.tiles_mem_size());
+    }
+
+    LogMsg("coast_tiles: flight with a budget of %0.1f MB: %d loads, %d tiles, max memory %0.1f MB",
+           tiled.tile_budget_ / (1024.0 * 1024.0), n_loaded, tiled.n_tiles(), max_mem / (1024.0 * 1024.0));
+
+    std::error_code ec;
+    std::filesystem::remove_all(dir, ec);
+}
+
+//------------------------------------------------------------------------------------
+// Legacy airport lookup, linear scan vs. AirportIndex
+//
+static void
+BenchAirportIndex()
+{
+    static constexpr int kNArpt = 5000;
+    static constexpr float kArptLimit = 18000;      // m, as in airport.cpp
+    std::mt19937 rng(4711);
+
+    // 2/3 clustered in Europe and the US, the rest anywhere
+    std::vector<std::unique_ptr<Airport>> arpts;
+    std::uniform_real_distribution<float> lon_d(-180.0f, 180.0f), lat_d(-89.0f, 89.0f);
+    std::uniform_real_distribution<float> eu_lon(-10.0f, 30.0f), eu_lat(36.0f, 62.0f);
+    std::uniform_real_distribution<float> us_lon(-125.0f, -70.0f), us_lat(25.0f, 49.0f);
+    for (int i = 0; i < kNArpt; i++) {
+        auto arpt = std::make_unique<Airport>();
+        switch (i % 3) {
+            case 0: arpt->mec_center = {eu_lon(rng), eu_lat(rng)}; break;
+            case 1: arpt->mec_center = {us_lon(rng), us_lat(rng)}; break;
+            default: arpt->mec_center = {lon_d(rng), lat_d(rng)}; break;
+        }
+        arpts.push_back(std::move(arpt));
+    }
+
+    Timer t_build;
+    AirportIndex index;
+    index.Build(arpts);
+    LogMsg("airport_index: %d airports, build: %0.2f ms", kNArpt, t_build.ms());
+
+    // half of the queries close to an airport
+    static constexpr int kNQuery = 100000;
+    std::vector<LLPos> query(kNQuery);
+    std::uniform_real_distribution<float> near_d(-0.3f, 0.3f);
+    for (int i = 0; i < kNQuery; i++) {
+        if (i & 1) {
+            const LLPos& c = arpts[rng() % kNArpt]->mec_center;
+            query[i] = {RA(c.lon + near_d(rng)), std::clamp(c.lat + near_d(rng), -89.0f, 89.0f)};
+        } else
+            query[i] = {lon_d(rng), lat_d(rng)};
+    }
+
+    // what LegacyAirportSnowDepth() did before the index
+    auto linear = [&arpts](const LLPos& pos) {
+        for (int i = 0; i < (int)arpts.size(); i++)
+            if (len(pos - arpts[i]->mec_center) < kArptLimit)
+                return i;
+        return -1;
+    };
+
+    std::vector<int> res_linear(kNQuery), res_index(kNQuery);
+    Timer t_linear;
+    for (int i = 0; i < kNQuery; i++)
+        res_linear[i] = linear(query[i]);
+    double ms_linear = t_linear.ms();
+
+    Timer t_index;
+    for (int i = 0; i < kNQuery; i++)
+        res_index[i] = index.FindFirst(query[i], kArptLimit);
+    double ms_index = t_index.ms();
+
+    int n_hit = std::count_if(res_linear.begin(), res_linear.end(), [](int i) { return i >= 0; });
+    LogMsg("airport_index: linear scan: %8.2f us/query", ms_linear * 1.0e3 / kNQuery);
+    LogMsg("airport_index: index:       %8.2f us/query, speedup %0.0fx", ms_index * 1.0e3 / kNQuery,
+           ms_linear / ms_index);
+    LogMsg("airport_index: %d queries in range, results: %s", n_hit,
+           res_linear == res_index ? "identical" : "DIFFERENT");
+
+    // FindAll() with the radius of ProbeAirports()
+    static constexpr float kProbeRadius = 100000;   // m, as in airport.cpp
+    static constexpr int kNQueryAll = 2000;
+    std::vector<int> all_linear, all_index;
+    size_t n_found = 0;
+    bool same = true;
+    for (int i = 0; i < kNQueryAll; i++) {
+        index.FindAll(query[i], kProbeRadius, all_index);
+        n_found += all_index.size();
+        all_linear.clear();
+        for (int k = 0; k < (int)arpts.size(); k++)
+            if (len(query[i] - arpts[k]->mec_center) < kProbeRadius)
+                all_linear.push_back(k);
+        same = same && all_linear == all_index;
+    }
+
+    LogMsg("airport_index: FindAll %0.0f km: %0.1f airports/query, results: %s", kProbeRadius / 1000,
+           (double)n_found / kNQueryAll, same ? "identical" : "DIFFERENT");
+}
+
+//------------------------------------------------------------------------------------
+// CollectAirports() on a synthetic X-Plane installation, cold and from the cache
+//
+static void
+BenchCollect()
+{
+    static constexpr int kNPacks = 1000;
+    static constexpr int kNLegacy = 50;         // with a xa-snow.cfg
+    std::string xp = std::filesystem::absolute("bench_xp").string();
+    std::string cs = xp + "/Custom Scenery";
+    std::filesystem::create_directories(cs);
+
+    std::mt19937 rng(4711);
+    std::uniform_real_distribution<float> lon_d(-10.0f, 30.0f), lat_d(36.0f, 62.0f), d_d(-0.02f, 0.02f);
+    {
+        std::ofstream ini(cs + "/scenery_packs.ini");
+        ini << "I\n1000 Version\nSCENERY\n\n";
+        for (int i = 0; i < kNPacks; i++) {
+            char name[20];
+            snprintf(name, sizeof(name), "pack_%04d", i);
+            std::string dir = cs + "/" + name + "/";
+            std::filesystem::create_directories(dir + "Earth nav data");
+            ini << "SCENERY_PACK Custom Scenery/" << name << "/\n";
+            if (i % (kNPacks / kNLegacy) != 0)
+                continue;
+
+            std::ofstream(dir + "xa-snow.cfg") << "max_snow_depth=0.05\n";
+            std::ofstream apt(dir + "Earth nav data/apt.dat");
+            float lon = lon_d(rng), lat = lat_d(rng);
+            apt << "I\n1200 Generated\n\n1    100 0 0 " << name << " Bench Airport\n";
+            for (int r = 0; r < 3; r++)
+                apt << "100 45.00 15 0 0.00 1 3 0 " << r + 1 << "L " << lat + d_d(rng) << " " << lon + d_d(rng)
+                    << " 0 148 3 1 0 0 " << r + 19 << "R " << lat + d_d(rng) << " " << lon + d_d(rng)
+                    << " 0 140 3 1 0 0\n";
+            // taxiways etc. make the bulk of a real apt.dat
+            for (int k = 0; k < 20000; k++)
+                apt << "111 " << lat + d_d(rng) << " " << lon + d_d(rng) << "\n";
+            apt << "99\n";
+        }
+    }
+
+    std::string saved_output_dir = output_dir;
+    output_dir = xp;
+    std::filesystem::remove(xp + "/airports.cache");
+
+    auto snapshot = []() {
+        std::string s;
+        char buf[200];
+        for (auto& a : airports) {
+            snprintf(buf, sizeof(buf), "%s %.9g %.9g %.9g %.9g %.9g %d\n", a->name.c_str(), a->max_snow_depth,
+                     a->mec_center.lon, a->mec_center.lat, a->mec_radius, a->elevation, (int)a->runways.size());
+            s += buf;
+        }
+        return s;
+    };
+
+    Timer t_cold;
+    CollectAirports(xp);
+    double ms_cold = t_cold.ms();
+    std::string cold = snapshot();
+
+    Timer t_warm;
+    CollectAirports(xp);
+    double ms_warm = t_warm.ms();
+    std::string warm = snapshot();
+
+    LogMsg("collect: %d packs, %d legacy airports", kNPacks, (int)airports.size());
+    LogMsg("collect: cold: %0.1f ms, from cache: %0.1f ms, results: %s", ms_cold, ms_warm,
+           cold == warm ? "identical" : "DIFFERENT");
+
+    // elevations as probed in the sim survive a restart
+    for (size_t i = 0; i < airports.size(); i += 2)
+        airports[i]->elevation = 100.0f + i;
+    std::string probed = snapshot();
+
+    Timer t_save;
+    SaveAirportsCache();
+    double ms_save = t_save.ms();
+    CollectAirports(xp);
+    LogMsg("collect: save elevations: %0.1f ms, reloaded: %s", ms_save,
+           snapshot() == probed ? "identical" : "DIFFERENT");
+
+    airports.clear();
+    output_dir = saved_output_dir;
+    std::error_code ec;
+    std::filesystem::remove_all(xp, ec);
+}
+
+//------------------------------------------------------------------------------------
+// MEC of airports with many runways, iterative MinEnclosingCircle() vs. the recursive
+// Welzl() it replaced
+//
+static Circle
+RefCircleFrom(const Vec2& a, const Vec2& b)
+{
+    return {0.5f * (a + b), 0.5f * len(a - b)};
+}
+
+static Circle
+RefCircleFrom(const Vec2& v1, const Vec2& v2, const Vec2& v3)
+{
+    Circle c = RefCircleFrom(v1, v2);
+    if (len(v3 - c.c) <= c.r)
+        return c;
+
+    c = RefCircleFrom(v1, v3);
+    if (len(v2 - c.c) <= c.r)
+        return c;
+
+    c = RefCircleFrom(v2, v3);
+    if (len(v1 - c.c) <= c.r)
+        return c;
+
+    Vec2 v21 = v2 - v1;
+    Vec2 v31 = v3 - v1;
+
+    float lv1 = v1.x * v1.x + v1.y * v1.y;
+    float lv2 = v2.x * v2.x + v2.y * v2.y;
+    float lv3 = v3.x * v3.x + v3.y * v3.y;
+
+    Vec2 d{0.5f * (lv2 - lv1), 0.5f * (lv3 - lv1)};
+    float D = v21.x * v31.y - v31.x * v21.y;
+    Vec2 cc{(d.x * v31.y - d.y * v21.y) / D, (v21.x * d.y - v31.x * d.x) / D};
+    return {cc, len(v1 - cc)};
+}
+
+static Circle
+RefWelzl(std::vector<Vec2>& P, std::vector<Vec2> R, int n)
+{
+    if (n == 0 || R.size() == 3) {
+        if (R.empty())
+            return {{0, 0}, 0};
+        if (R.size() == 1)
+            return {R[0], 0};
+        if (R.size() == 2)
+            return RefCircleFrom(R[0], R[1]);
+        return RefCircleFrom(R[0], R[1], R[2]);
+    }
+
+    int idx = rand() % n;
+    Vec2 p = P[idx];
+    std::swap(P[idx], P[n - 1]);
+
+    Circle d = RefWelzl(P, R, n - 1);
+    if (len(d.c - p) <= d.r)
+        return d;
+
+    R.push_back(p);
+    return RefWelzl(P, R, n - 1);
+}
+
+static void
+BenchMEC()
+{
+    static constexpr int kNArpt = 2000;
+    std::mt19937 rng(4711);
+    std::uniform_int_distribution<int> n_d(25, 50);     // runways
+    std::uniform_real_distribution<float> pos_d(-2500.0f, 2500.0f);
+
+    std::vector<std::vector<Vec2>> arpts(kNArpt);
+    size_t n_ends = 0;
+    for (auto& a : arpts) {
+        a.resize(2 * n_d(rng));
+        for (auto& v : a)
+            v = {pos_d(rng), 0.6f * pos_d(rng)};
+        n_ends += a.size();
+    }
+
+    std::vector<Circle> ref(kNArpt), mec(kNArpt);
+    auto work = arpts;
+    Timer t_ref;
+    for (int i = 0; i < kNArpt; i++)
+        ref[i] = RefWelzl(work[i], {}, work[i].size());
+    double ms_ref = t_ref.ms();
+
+    work = arpts;
+    Timer t_mec;
+    for (int i = 0; i < kNArpt; i++)
+        mec[i] = MinEnclosingCircle(work[i]);
+    double ms_mec = t_mec.ms();
+
+    // the MEC is unique so both must agree up to rounding, unless one does not enclose all points
+    auto max_outside = [](const std::vector<Vec2>& points, const Circle& c) {
+        float out = 0.0f;
+        for (auto& v : points)
+            out = std::max(out, len(v - c.c) - c.r);
+        return out;
+    };
+
+    int n_same = 0, n_ref_bad = 0, n_mec_bad = 0;
+    for (int i = 0; i < kNArpt; i++) {
+        n_same += len(mec[i].c - ref[i].c) <= 0.01f && fabsf(mec[i].r - ref[i].r) <= 0.01f;
+        n_ref_bad += max_outside(arpts[i], ref[i]) > 0.01f;
+        n_mec_bad += max_outside(arpts[i], mec[i]) > 0.02f;
+    }
+
+    LogMsg("mec: %d airports, %0.1f runway ends per airport", kNArpt, (double)n_ends / kNArpt);
+    LogMsg("mec: recursive Welzl: %6.2f us/airport", ms_ref * 1.0e3 / kNArpt);
+    LogMsg("mec: iterative:       %6.2f us/airport", ms_mec * 1.0e3 / kNArpt);
+    LogMsg("mec: same circle (1 cm): %d, points outside: recursive %d, iterative %d",
+           n_same, n_ref_bad, n_mec_bad);
+}
+
+//------------------------------------------------------------------------------------
+// apt.dat parsing, the mapped scanner vs. the getline parser it replaced
+//
+static std::unique_ptr<Airport>
+RefParseAptDat(const std::string& fn)
+{
+    std::ifstream apt(fn);
+    if (apt.fail())
+        return nullptr;
+
+    auto arpt = std::make_unique<Airport>();
+    std::string line;
+    bool have_airport = false;
+
+    while (std::getline(apt, line)) {
+        size_t i = line.find('\r');
+        if (i != std::string::npos)
+            line.resize(i);
+
+        if (line.starts_with("1 ")) {
+            if (have_airport)
+                return arpt;
+
+            have_airport = true;
+            int ofs;
+            sscanf(line.c_str(), "%*d %*d %*d %*d %n", &ofs);
+            if (ofs < (int)line.size())
+                line.erase(0, ofs);
+            arpt->name = line;
+            continue;
+        }
+
+        if (line.starts_with("100 ")) {
+            std::vector<std::string> words;
+            char *pch = strtok((char *)line.c_str(), " ");
+            while (pch != NULL) {
+                words.push_back(pch);
+                pch = strtok(NULL, " ");
+            }
+
+            if (words.size() < 20)
+                continue;
+
+            Runway rwy;
+            rwy.name = words[8];
+            rwy.end1.lat = std::atof(words[9].c_str());
+            rwy.end1.lon = std::atof(words[10].c_str());
+            rwy.end2.lat = std::atof(words[18].c_str());
+            rwy.end2.lon = std::atof(words[19].c_str());
+            arpt->runways.push_back(rwy);
+        }
+    }
+
+    return arpt;
+}
+
+static void
+BenchAptDat()
+{
+    static constexpr size_t kSize = 200 * 1024 * 1024;
+    std::string fn = "bench_apt.dat";
+    std::mt19937 rng(4711);
+    std::uniform_real_distribution<float> d_d(-0.02f, 0.02f);
+
+    // one big airport: runways scattered between taxiway, sign, ... rows
+    {
+        std::ofstream apt(fn, std::ios::binary);
+        apt << "I\r\n1200 Generated\r\n\r\n1    681 0 0 ENGM Oslo Gardermoen\r\n";
+        char buf[200];
+        size_t size = 0;
+        for (int i = 0; size < kSize; i++) {
+            int n;
+            if (i % 50000 == 0)
+                n = snprintf(buf, sizeof(buf), "100 45.11 15 0 0.00 1 3 0 %02dL  %0.8f  %012.8f 0 148 3 1 0 0 "
+                             "%02dR  %0.8f  %012.8f 0 140 3 2 1 0\r\n", i / 50000 % 36 + 1, 60.2 + d_d(rng),
+                             11.08 + d_d(rng), (i / 50000 + 18) % 36 + 1, 60.2 + d_d(rng), 11.08 + d_d(rng));
+            else if (i % 3)
+                n = snprintf(buf, sizeof(buf), "111  %0.8f  %012.8f\r\n", 60.2 + d_d(rng), 11.08 + d_d(rng));
+            else
+                n = snprintf(buf, sizeof(buf), "20 %0.8f %0.8f 123.45 0 2 {@Y,^l}A1{^r}\r\n", 60.2 + d_d(rng),
+                             11.08 + d_d(rng));
+            apt.write(buf, n);
+            size += n;
+        }
+        apt << "1    100 0 0 XXXX The next airport\r\n"
+               "100 45.11 15 0 0.00 1 3 0 01L 1.0 2.0 0 148 3 1 0 0 19R 1.5 2.5 0 140 3 2 1 0\r\n99\r\n";
+    }
+
+    double mb = std::filesystem::file_size(fn) / (1024.0 * 1024.0);
+
+    // warm the page cache
+    RefParseAptDat(fn);
+
+    Timer t_ref;
+    auto ref = RefParseAptDat(fn);
+    double ms_ref = t_ref.ms();
+
+    Timer t_new;
+    auto arpt = ParseAptDat(fn);
+    double ms_new = t_new.ms();
+
+    bool same = ref && arpt && ref->name == arpt->name && ref->runways.size() == arpt->runways.size();
+    for (size_t i = 0; same && i < ref->runways.size(); i++) {
+        const Runway& a = ref->runways[i];
+        const Runway& b = arpt->runways[i];
+        same = a.name == b.name && a.end1.lat == b.end1.lat && a.end1.lon == b.end1.lon
+               && a.end2.lat == b.end2.lat && a.end2.lon == b.end2.lon;
+    }
+
+    LogMsg("apt_dat: %0.0f MB, %d runways of '%s'", mb, arpt ? (int)arpt->runways.size() : -1,
+           arpt ? arpt->name.c_str() : "");
+    LogMsg("apt_dat: getline: %7.1f ms, %7.1f MB/s", ms_ref, mb * 1000.0 / ms_ref);
+    LogMsg("apt_dat: mapped:  %7.1f ms, %7.1f MB/s", ms_new, mb * 1000.0 / ms_new);
+    LogMsg("apt_dat: results: %s", same ? "identical" : "DIFFERENT");
+
+    std::filesystem::remove(fn);
+}
+
+//------------------------------------------------------------------------------------
+// Flight loop instrumentation, cost of a timed section and accuracy of the percentiles
+//
+static void
+BenchLoopStats()
+{
+    static constexpr int kN = 1000000;
+    LoopStats stats;
+
+    // an empty section, so this is the overhead of the instrumentation
+    Timer t_empty;
+    for (int i = 0; i < kN; i++)
+        LoopStats::Timer t(stats, LoopStats::kDrefs);
+    double ns_empty = t_empty.ms() * 1.0e6 / kN;
+    const LoopHistogram& h_empty = stats.hist_[LoopStats::kDrefs];
+    LogMsg("loop_stats: timed section: %0.1f ns, measured inside: p50 %llu ns, p99 %llu ns", ns_empty,
+           (unsigned long long)h_empty.Percentile(0.5), (unsigned long long)h_empty.Percentile(0.99));
+
+    // durations with a long tail as seen in a flight loop
+    std::mt19937 rng(4711);
+    std::lognormal_distribution<double> d(7.0, 1.0);
+    std::vector<uint64_t> samples(kN);
+    LoopHistogram& h = stats.hist_[LoopStats::kTotal];
+    for (auto& ns : samples) {
+        ns = d(rng);
+        h.Add(ns);
+    }
+
+    std::sort(samples.begin(), samples.end());
+    double max_err = 0.0;
+    for (double p : {0.5, 0.9, 0.99, 0.999}) {
+        uint64_t exact = samples[(size_t)(p * kN + 0.5) - 1];
+        uint64_t approx = h.Percentile(p);
+        double err = ((double)approx - exact) / exact;
+        max_err = std::max(max_err, fabs(err));
+        LogMsg("loop_stats: p%-5g exact: %7llu ns, histogram: %7llu ns, %+5.1f%%", p * 100,
+               (unsigned long long)exact, (unsigned long long)approx, err * 100);
+    }
+
+    LogMsg("loop_stats: max error %0.1f%%: %s", max_err * 100, max_err <= 0.25 ? "ok" : "TOO LARGE");
+    stats.n_full_ = kN / 8;
+    stats.n_throttled_ = kN - kN / 8;
+    stats.Log();
+}
+
+//------------------------------------------------------------------------------------
+// Write avoidance for the snow datarefs, a flight loop with a mock XPLMSetDataf
+//
+static float mock_dref[4];              // what the sim holds
+static uint64_t mock_n_set;
+
+static void
+MockSetDataf(XPLMDataRef dref, float value)
+{
+    *(float *)dref = value;
+    mock_n_set++;
+}
+
+static void
+BenchDrefWriter()
+{
+    static constexpr double kFramePeriod = 1.0 / 60.0;
+    static constexpr int kNFrames = 30 * 60 * 60;      // 30 min
+    enum { kSnow, kRwySnow, kIce, kRwyCond };
+
+    // as in xa-snow.cpp
+    DrefWriter w[4] = {{MockSetDataf, 1.0e-4f, 0.1, 1.0}, {MockSetDataf, 1.0e-4f, 0.1, 1.0},
+                       {MockSetDataf, 1.0e-4f, 0.1, 1.0}, {MockSetDataf, 0.0f, 0.0, 1.0}};
+    for (int i = 0; i < 4; i++)
+        w[i].set_dref(&mock_dref[i]);
+
+    DrefWriter::n_written_ = DrefWriter::n_suppressed_ = 0;
+    mock_n_set = 0;
+    mock_dref[kRwyCond] = 8.0f;
+
+    // snow depth below the aircraft changes every few minutes, in between it is smoothed
+    std::mt19937 rng(4711);
+    std::uniform_real_distribution<float> depth_d(0.0f, 0.25f);
+    float snow_depth = 0.0f, snow_depth_n = 0.0f;
+    float value[4]{};
+    float max_dev = 0.0f;
+    Timer t;
+    for (int frame = 0; frame < kNFrames; frame++) {
+        double now = frame * kFramePeriod;
+        if (frame % (3 * 60 * 60) == 0)
+            snow_depth_n = depth_d(rng);
+
+        // X-Plane's weather sets the friction on its own now and then
+        if (frame % (20 * 60) == 0)
+            mock_dref[kRwyCond] = 8.0f;
+
+        float alpha = kFramePeriod / 10.0f;
+        snow_depth = alpha * snow_depth_n + (1 - alpha) * snow_depth;
+        if (frame % 8 == 0) {
+            value[kSnow] = 0.23f + 2.7f * snow_depth;       // roughly SnowDepthToXplaneSnowNow()
+            value[kRwySnow] = 0.25f + 0.3f * snow_depth;
+            value[kIce] = 0.05f + 3.4f * snow_depth;
+        }
+
+        float current_rwy_cond = mock_dref[kRwyCond];
+        value[kRwyCond] = std::min(current_rwy_cond, 6.0f);
+
+        for (int i = 0; i < 3; i++) {
+            w[i].Set(value[i], now);
+            max_dev = std::max(max_dev, fabsf(mock_dref[i] - value[i]));
+        }
+        w[kRwyCond].Set(value[kRwyCond], current_rwy_cond, now);
+    }
+    double ms = t.ms();
+
+    uint64_t n_before = 4ull * kNFrames;
+    LogMsg("dref_writer: %d frames, XPLMSetDataf calls: before %llu, now %llu, %0.2f per frame, %0.1fx fewer",
+           kNFrames, (unsigned long long)n_before, (unsigned long long)mock_n_set, (double)mock_n_set / kNFrames,
+           (double)n_before / mock_n_set);
+    LogMsg("dref_writer: suppressed: %llu, max deviation of the sim's value: %0.5f, %0.1f ns per frame",
+           (unsigned long long)DrefWriter::n_suppressed_, max_dev, ms * 1.0e6 / kNFrames);
+    LogMsg("dref_writer: friction: %s", mock_dref[kRwyCond] == 6.0f ? "clamped" : "NOT CLAMPED");
+}
+
+//------------------------------------------------------------------------------------
+struct Benchmark {
+    const char *name;
+    void (*func)();
+};
+
+static const Benchmark benchmarks[] = {
+    {"load_csv", BenchLoadCSV},
+    {"compact", BenchCompact},
+    {"get_many", BenchGetMany},
+    {"halo", BenchHalo},
+    {"coast_map", BenchCoastMap},
+    {"coast_tiles", BenchCoastTiles},
+    {"airport_index", BenchAirportIndex},
+    {"collect", BenchCollect},
+    {"mec", BenchMEC},
+    {"apt_dat", BenchAptDat},
+    {"loop_stats", BenchLoopStats},
+    {"dref_writer", BenchDrefWriter},
+};
+
+int main(int argc, char **argv)
+{
+    xp_dir = ".";
+    plugin_dir = ".";
+    output_dir = ".";
+
+    for (auto& b : benchmarks) {
+        bool run = (argc == 1);
+        for (int i = 1; i < argc; i++)
+            run = run || (strcmp(argv[i], b.name) == 0);
+
+        if (run) {
+            LogMsg("---------- %s ----------", b.name);
+            b.func();
+        }
+    }
+
+    return 0;
+}
@@ -21,6 +21,7 @@
 //
 
 #include <cstdio>
+#include <cstring>
 #include <memory>
 #include <cmath>
 #include <cassert>
@@ -28,6 +29,16 @@
 #include <tuple>
 #include <array>
 #include <algorithm>
+#include <thread>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <filesystem>
+#include <bit>
+#include <future>
+#include <chrono>
+
+#include <zlib.h>
 
 #include "xa-snow.h"
 #include "coast_map.h"
@@ -48,11 +59,11 @@ enum State {
 static constexpr int kDirShift = 4;
 static constexpr int kItemMask = 0xf;
 
-// These arrays can be quite large, use a compact representation
-// []wmap_;		    // encoded as (dir << kDirShift)|sXxx
+// The classification produces dense arrays that are packed afterwards
+// []wmap;		    // encoded as (dir << kDirShift)|sXxx
 //
-// only valid if for wmap_[idx] == sWater
-// []nearest_land_;	// encoded as (dir << kDirShift)|dist in steps
+// only valid if for wmap[idx] != sLand
+// []nearest_land;	// pairs (dx, dy) of grid steps to the nearest land, (0, 0) = none in range
 
 CoastMap coast_map;
 
@@ -112,32 +123,48 @@ CoastMap::ll_2_idx(float lon, float lat) const
     return idx;
 }
 
+// -> grid, idx into grid, resolution of grid
+std::tuple<const PackedGrid *, int, float>
+CoastMap::locate(float lon, float lat) const
+{
+    if (const CoastTile *t = find_tile(lon, lat))
+        return {&t->grid_, t->ll_2_idx(lon >= 180.0f ? lon - 360.0f : lon, lat), t->resolution_};
+
+    return {&grid_, ll_2_idx(lon, lat), resolution_};
+}
+
 bool
 CoastMap::is_water(float lon, float lat) const
 {
-    int idx = ll_2_idx(lon, lat);
-    return (wmap_[idx] & kItemMask) == sWater;
+    auto [grid, idx, resolution] = locate(lon, lat);
+    return grid->state(idx) == sWater;
 }
 
 // -> is_water, have_nl, lon, lat
 std::tuple<bool, bool, float, float>
 CoastMap::nearest_land(float lon, float lat) const
 {
-    int idx = ll_2_idx(lon, lat);
-    if ((wmap_[idx] & kItemMask) == sLand)
+    const PackedGrid *grid;
+    int idx;
+    float resolution;
+    std::tie(grid, idx, resolution) = locate(lon, lat);
+    if (grid->state(idx) == sLand)
         return std::tuple(false, false, 0, 0);
 
-    uint8_t v = nearest_land_[idx];
-    if (v == 0)
-        return std::tuple(true, false, 0, 0);
+    int dx, dy;
+    if (!grid->nearest_land(idx, dx, dy)) {
+        if (grid == &grid_)
+            return std::tuple(true, false, 0, 0);
 
-    int steps = (v & kItemMask);
-    int d = v >> kDirShift;
-    //LogMsg("dir: %d, steps: %d", d, steps);
-    assert(0 <= d && d < 8);
+        // a tile only looks as far as its margin, beyond that ask the global map
+        idx = ll_2_idx(lon, lat);
+        resolution = resolution_;
+        if (grid_.state(idx) == sLand || !grid_.nearest_land(idx, dx, dy))
+            return std::tuple(true, false, 0, 0);
+    }
 
-    lat = std::clamp(lat + steps * dir_y[d] * resolution_, -85.0f, 85.0f);
-    lon += steps * dir_x[d] * resolution_;
+    lat = std::clamp(lat + dy * resolution, -85.0f, 85.0f);
+    lon += dx * resolution;
 
     // to the external world
     if (lon >= 180.0f)
@@ -151,108 +178,389 @@ CoastMap::nearest_land(float lon, float lat) const
 bool
 CoastMap::is_land(float lon, float lat) const
 {
-    int idx = ll_2_idx(lon, lat);
-    return (wmap_[idx] & kItemMask) == sLand;
+    auto [grid, idx, resolution] = locate(lon, lat);
+    return grid->state(idx) == sLand;
+}
+
+bool
+CoastMap::is_land_global(float lon, float lat) const
+{
+    return grid_.state(ll_2_idx(lon, lat)) == sLand;
 }
 
 std::tuple<bool, int, int, int>
 CoastMap::is_coast(float lon, float lat) const
 {
-    int idx = ll_2_idx(lon, lat);
-    uint8_t v = wmap_[idx];
-    bool yes_no = (v & kItemMask) == sCoast;
-    int dir = v >> kDirShift;
-    return {yes_no, dir_x[dir], dir_y[dir], dir};
+    auto [grid, idx, resolution] = locate(lon, lat);
+    if (grid->state(idx) != sCoast)
+        return {false, dir_x[0], dir_y[0], 0};
+
+    int dir = grid->coast_dir(idx);
+    return {true, dir_x[dir], dir_y[dir], dir};
 }
 
-bool
-CoastMap::load(const std::string& dir)
+// Collect the grid points of a map with 'resolution' that are coast.
+// Only a small fraction of the grid points are coast so DepthMap's coastal
+// snow extension iterates over this list rather than over all grid points.
+void
+CoastMap::index_coast(float resolution)
 {
-    std::string filename = dir + "/ESACCI-LC-L4-WB-Ocean-Map-150m-P13Y-2000-v4.0.png";
-    FILE *fp = fopen(filename.c_str(), "rb");
-    if (fp == nullptr) {
-        LogMsg("Can't open file '%s'", filename.c_str());
-        return false;
+    // same dimensions and lon/lat math as DepthMap
+    int width = 360.0f / resolution;
+    int height = (int)(180.0f / resolution) + 1;
+
+    coast_cells_.clear();
+    for (int j = 0; j < height; j++) {
+        for (int i = 0; i < width; i++) {
+            float lon = i * resolution;
+            float lat = j * resolution - 90.0f;
+            int idx = ll_2_idx(lon, lat);
+            if (grid_.state(idx) != sCoast)
+                continue;
+
+            int dir = grid_.coast_dir(idx);
+            float lon_1 = (i + dir_x[dir]) * resolution;
+            float lat_1 = (j + dir_y[dir]) * resolution - 90.0f;
+            coast_cells_.push_back({(int16_t)i, (int16_t)j, (int8_t)dir_x[dir], (int8_t)dir_y[dir],
+                                    grid_.state(ll_2_idx(lon_1, lat_1)) == sWater});
+        }
     }
 
-    spng_ctx* ctx = spng_ctx_new(0);
-    if(ctx == nullptr)
+    LogMsg("Coast index: %d of %d grid points are coast", (int)coast_cells_.size(), width * height);
+}
+
+//------------------------------------------------------------------------------------
+// byte offsets of the arrays in the packed map, 8 byte aligned
+struct PackedLayout {
+    size_t state, has_nl, coast_rank, nl_rank, coast_dir, nearest_land, size;
+
+    PackedLayout(size_t n, size_t n_coast, size_t n_nl) {
+        size_t n_sw = (n + 31) / 32;
+        size_t n_nw = (n + 63) / 64;
+        state = 0;
+        has_nl = state + 8 * n_sw;
+        coast_rank = has_nl + 8 * n_nw;
+        nl_rank = coast_rank + 4 * n_sw;
+        coast_dir = (nl_rank + 4 * n_nw + 7) & ~(size_t)7;
+        nearest_land = coast_dir + n_coast;
+        size = (nearest_land + 2 * n_nl + 7) & ~(size_t)7;
+    }
+};
+
+size_t
+PackedGrid::packed_size(size_t n, size_t n_coast, size_t n_nl)
+{
+    return PackedLayout(n, n_coast, n_nl).size;
+}
+
+void
+PackedGrid::set(int width, int height, const uint8_t *data, size_t n_coast, size_t n_nl)
+{
+    PackedLayout l((size_t)width * height, n_coast, n_nl);
+    width_ = width;
+    height_ = height;
+    n_coast_ = n_coast;
+    n_nl_ = n_nl;
+    size_ = l.size;
+    has_nl_ = (const uint64_t *)(data + l.has_nl);
+    coast_rank_ = (const uint32_t *)(data + l.coast_rank);
+    nl_rank_ = (const uint32_t *)(data + l.nl_rank);
+    coast_dir_ = data + l.coast_dir;
+    nearest_land_ = (const int8_t *)(data + l.nearest_land);
+    state_ = (const uint64_t *)(data + l.state);     // last as is_loaded() relies on it
+}
+
+void
+PackedGrid::pack(int width, int height, const uint8_t *wmap, const int8_t *nearest_land)
+{
+    size_t n = (size_t)width * height;
+    auto has_nl = [&](size_t idx) {
+        return (wmap[idx] & kItemMask) != sLand && (nearest_land[2 * idx] != 0 || nearest_land[2 * idx + 1] != 0);
+    };
+
+    size_t n_coast = 0, n_nl = 0;
+    for (size_t idx = 0; idx < n; idx++) {
+        n_coast += (wmap[idx] & kItemMask) == sCoast;
+        n_nl += has_nl(idx);
+    }
+
+    PackedLayout l(n, n_coast, n_nl);
+    auto buf = std::make_unique<uint64_t[]>(l.size / 8);     // zeroed
+    uint8_t *data = (uint8_t *)buf.get();
+    auto state = (uint64_t *)(data + l.state);
+    auto has_nl_bits = (uint64_t *)(data + l.has_nl);
+    auto coast_rank = (uint32_t *)(data + l.coast_rank);
+    auto nl_rank = (uint32_t *)(data + l.nl_rank);
+    auto coast_dir = data + l.coast_dir;
+    auto nl = (int8_t *)(data + l.nearest_land);
+
+    size_t i_coast = 0, i_nl = 0;
+    for (size_t idx = 0; idx < n; idx++) {
+        if (idx % 32 == 0)
+            coast_rank[idx / 32] = i_coast;
+        if (idx % 64 == 0)
+            nl_rank[idx / 64] = i_nl;
+
+        uint64_t s = wmap[idx] & kItemMask;
+        state[idx / 32] |= s << (2 * (idx % 32));
+        if (s == sCoast)
+            coast_dir[i_coast++] = wmap[idx] >> kDirShift;
+
+        if (has_nl(idx)) {
+            has_nl_bits[idx / 64] |= 1ULL << (idx % 64);
+            nl[2 * i_nl] = nearest_land[2 * idx];
+            nl[2 * i_nl + 1] = nearest_land[2 * idx + 1];
+            i_nl++;
+        }
+    }
+
+    buf_ = std::move(buf);
+    set(width, height, data, n_coast, n_nl);
+}
+
+int
+PackedGrid::coast_dir(int idx) const
+{
+    uint64_t w = state_[idx >> 5];
+    int shift = 2 * (idx & 31);
+
+    // sCoast is the only state with the high bit set
+    uint64_t coast_bits = (w >> 1) & 0x5555555555555555ULL & ((1ULL << shift) - 1);
+    return coast_dir_[coast_rank_[idx >> 5] + std::popcount(coast_bits)];
+}
+
+bool
+PackedGrid::nearest_land(int idx, int& dx, int& dy) const
+{
+    uint64_t w = has_nl_[idx >> 6];
+    uint64_t bit = 1ULL << (idx & 63);
+    if (!(w & bit))
         return false;
 
-    // Ignore and don't calculate chunk CRC's
-    spng_set_crc_action(ctx, SPNG_CRC_USE, SPNG_CRC_USE);
+    size_t k = nl_rank_[idx >> 6] + std::popcount(w & (bit - 1));
+    dx = nearest_land_[2 * k];
+    dy = nearest_land_[2 * k + 1];
+    return true;
+}
 
-    // Set memory usage limits for storing standard and unknown chunks,
-    // this is important when reading untrusted files!
-    size_t limit = 1024 * 1024 * 10;
-    spng_set_chunk_limits(ctx, limit, limit);
+//------------------------------------------------------------------------------------
+// The cache holds the packed result of the classification of the png:
+// header, packed map, see PackedLayout
+// It is keyed on crc32 and size of the png, the payload is protected by a crc32.
+//
+static constexpr char kCacheMagic[8] = "XACOAST";
+static constexpr uint32_t kCacheVersion = 3;     // bump whenever the classification changes
+static constexpr char kCacheName[] = "coast_map.cache";
+static constexpr char kTileDir[] = "coast_tiles";       // see load_tile()
 
-    // Set source file
-    spng_set_png_file(ctx, fp);
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    int32_t width, height;
+    uint32_t png_crc;
+    uint32_t crc;               // of the payload
+    uint64_t png_size;
+    uint64_t payload_size;
+    uint64_t n_coast, n_nl;
+};
 
-    struct spng_ihdr ihdr;
-    int ret = spng_get_ihdr(ctx, &ihdr);
-    if (ret) {
-        LogMsg("spng_get_ihdr() error: %s\n", spng_strerror(ret));
-        fclose(fp);
-        spng_ctx_free(ctx);
+bool
+CoastMap::load_cache(const std::string& fn, uint32_t png_crc, uint64_t png_size)
+{
+    auto cache = std::make_unique<MappedFile>();
+    if (!cache->Open(fn))
+        return false;
+
+    const uint8_t *data = cache->data();
+    size_t size = cache->size();
+
+    CacheHeader hdr;
+    if (size < sizeof(hdr)) {
+        LogMsg("Coast map cache '%s' is truncated", fn.c_str());
         return false;
     }
 
-    width_ = ihdr.width;
-    height_ = ihdr.height;
-    int color_type = ihdr.color_type;
-    int bit_depth = ihdr.bit_depth;
+    memcpy(&hdr, data, sizeof(hdr));
+    if (memcmp(hdr.magic, kCacheMagic, sizeof(hdr.magic)) != 0 || hdr.version != kCacheVersion
+        || hdr.header_size != sizeof(hdr) || hdr.width <= 0 || hdr.height <= 0
+        || hdr.n_coast > (uint64_t)hdr.width * hdr.height || hdr.n_nl > (uint64_t)hdr.width * hdr.height
+        || hdr.payload_size != PackedGrid::packed_size((size_t)hdr.width * hdr.height, hdr.n_coast, hdr.n_nl)
+        || size != sizeof(hdr) + hdr.payload_size) {
+        LogMsg("Coast map cache '%s' has an invalid header or version", fn.c_str());
+        return false;
+    }
 
-    LogMsg("w: %d, h: %d, color_type: %d, bit_depth: %d", width_, height_, color_type, bit_depth);
+    if (hdr.png_crc != png_crc || hdr.png_size != png_size) {
+        LogMsg("Coast map cache '%s' is for a different png", fn.c_str());
+        return false;
+    }
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, data + sizeof(hdr), hdr.payload_size);
+    if (crc != hdr.crc) {
+        LogMsg("Coast map cache '%s' has an invalid checksum", fn.c_str());
+        return false;
+    }
 
+    width_ = hdr.width;
+    height_ = hdr.height;
     resolution_ = 360.0f / width_;
-    if ((resolution_ != 180.0f / height_) || bit_depth != 8) {
-        LogMsg("Invalid map");
-        fclose(fp);
-        spng_ctx_free(ctx);
+    grid_.buf_ = nullptr;
+    grid_.set(width_, height_, data + sizeof(hdr), hdr.n_coast, hdr.n_nl);
+    cache_ = std::move(cache);
+    LogMsg("Coast map loaded from cache '%s'", fn.c_str());
+    return true;
+}
+
+bool
+CoastMap::save_cache(const std::string& fn, uint32_t png_crc, uint64_t png_size) const
+{
+    CacheHeader hdr{};
+    memcpy(hdr.magic, kCacheMagic, sizeof(hdr.magic));
+    hdr.version = kCacheVersion;
+    hdr.header_size = sizeof(hdr);
+    hdr.width = width_;
+    hdr.height = height_;
+    hdr.png_crc = png_crc;
+    hdr.png_size = png_size;
+    hdr.payload_size = grid_.size_;
+    hdr.n_coast = grid_.n_coast_;
+    hdr.n_nl = grid_.n_nl_;
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, grid_.data(), grid_.size_);
+    hdr.crc = crc;
+
+    // write to a temp file first so readers never see a partial file
+    std::string tmp_fn = fn + ".tmp";
+    std::ofstream f(tmp_fn, std::ios::binary);
+    if (!f.is_open()) {
+        LogMsg("Can't create coast map cache '%s'", tmp_fn.c_str());
         return false;
     }
 
-    LogMsg("Decoded: '%s', %s", filename.c_str(), "PNG");
+    f.write((const char *)&hdr, sizeof(hdr));
+    f.write((const char *)grid_.data(), grid_.size_);
+    f.close();
 
-    auto img = std::make_unique<uint32_t[]>(height_ * width_);
-    ret = spng_decode_image(ctx, img.get(), sizeof(uint32_t) * height_ * width_, SPNG_FMT_RGBA8, 0);
-    fclose(fp);
-    spng_ctx_free(ctx);
+    std::error_code ec;
+    if (!f.fail())
+        std::filesystem::rename(tmp_fn, fn, ec);
 
-    if (ret) {
-        LogMsg("spng_decode_image() error: %s\n", spng_strerror(ret));
+    if (f.fail() || ec) {
+        LogMsg("Can't write coast map cache '%s'", fn.c_str());
+        std::filesystem::remove(tmp_fn, ec);
         return false;
     }
 
-    wmap_ = std::make_unique<uint8_t[]>(height_ * width_);
-    nearest_land_ = std::make_unique<uint8_t[]>(height_ * width_);
+    LogMsg("Coast map cache saved to '%s'", fn.c_str());
+    return true;
+}
+
+//------------------------------------------------------------------------------------
+bool
+CoastMap::load(const std::string& dir)
+{
+    std::string filename = dir + "/ESACCI-LC-L4-WB-Ocean-Map-150m-P13Y-2000-v4.0.png";
+    std::string png;
+    {
+        std::ifstream f(filename, std::ios::binary);
+        if (!f.is_open()) {
+            LogMsg("Can't open file '%s'", filename.c_str());
+            return false;
+        }
+
+        png.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+    }
+
+    uint32_t png_crc = crc32(crc32(0L, Z_NULL, 0), (const Bytef *)png.data(), png.size());
+    std::string cache_fn = output_dir + "/" + kCacheName;
+
+    if (!load_cache(cache_fn, png_crc, png.size())) {
+        if (!decode_png(png, filename))
+            return false;
+
+        save_cache(cache_fn, png_crc, png.size());
+    }
+
+    index_coast(kSnodResolution);
+
+    std::error_code ec;
+    std::string tile_dir = dir + "/" + kTileDir;
+    if (std::filesystem::is_directory(tile_dir, ec)) {
+        tile_dir_ = tile_dir;
+        LogMsg("Coast tiles are loaded on demand from '%s'", tile_dir_.c_str());
+    }
+
+    return true;
+}
+
+//------------------------------------------------------------------------------------
+// 1 bit per pixel water mask of the png with a halo of kPad pixels.
+// The halo wraps around in x and clamps in y like ij_2_idx() so probes
+// within kPad pixels need no index checks.
+//
+struct WaterMask {
+    static constexpr int kPad = 16;
+    int width, height;
+    int words;                      // per row
+    std::unique_ptr<uint64_t[]> bits;
+
+    WaterMask(int width, int height)
+        : width(width), height(height), words((width + 2 * kPad + 63) / 64),
+          bits(std::make_unique<uint64_t[]>((size_t)words * (height + 2 * kPad))) {}
 
-    // i,j are is 'png' coordinates, lon 0 = center
-    for (int i = 0; i < width_; i++) {
-        for (int j = 10; j < height_ - 10; j++) { // stay away from the poles
-            // i/j_cm are in "coast map" coordinates, lon 0 = left
+    uint64_t *row(int j) { return &bits[(size_t)(j + kPad) * words]; }
 
-            int i_cm = i;
-            int j_cm = j;
+    void set_water(int i, int j) {
+        i += kPad;
+        j += kPad;
+        bits[(size_t)j * words + (i >> 6)] |= (uint64_t)1 << (i & 63);
+    }
 
-            i_cm -= width_ / 2;
-            if (i_cm < 0)
-                i_cm += width_;
+    // row j of the image in RGBA8, water = black
+    void set_row(int j, const uint8_t *rgba) {
+        uint64_t *r = row(j);
+        for (int c = 0; c < width + 2 * kPad; c++) {
+            int i = c - kPad;
+            if (i < 0)
+                i += width;
+            else if (i >= width)
+                i -= width;
 
-            auto is_water_pix = [&](int i, int j) {
-                j = height_ - j; // as the image (0,0) is top left to flip y values
-                int idx = ij_2_idx(i, j);
-                uint32_t pixel = img[idx];
-                return (pixel & 0x00FFFFFF) == 0;   // not the alpha channel
-            };
+            const uint8_t *p = rgba + 4 * i;
+            if ((p[0] | p[1] | p[2]) == 0)  // not the alpha channel
+                r[c >> 6] |= (uint64_t)1 << (c & 63);
+        }
+    }
 
-            int idx = j_cm * width_ + i_cm;
-            assert(0 <= idx && idx < width_ * height_);
+    void fill_halo_rows() {
+        for (int k = 1; k <= kPad; k++) {
+            memcpy(row(-k), row(0), words * sizeof(uint64_t));
+            memcpy(row(height - 1 + k), row(height - 1), words * sizeof(uint64_t));
+        }
+    }
 
-            if (is_water_pix(i, j)) {
-                wmap_[idx] = sWater;
+    bool is_water(int i, int j) const {
+        i += kPad;
+        j += kPad;
+        return (bits[(size_t)j * words + (i >> 6)] >> (i & 63)) & 1;
+    }
+};
+
+// Classify the pixels of rows [j_begin, j_end) of a raster in coast map coordinates.
+// is_water(i, j) must accept i, j up to 3 pixels outside of the raster.
+template<typename F>
+static void
+Classify(F is_water, int width, int j_begin, int j_end, uint8_t *wmap)
+{
+    for (int j = j_begin; j < j_end; j++) {
+        for (int i = 0; i < width; i++) {
+            int idx = j * width + i;
+
+            if (is_water(i, j)) {
+                wmap[idx] = sWater;
 				// we check whether to the opposite side is only water and in direction 'dir' is land
 				// if yes we sum up all unity vectors in dir to get the 'average' direction
                 float sum_x = 0.0f;
@@ -262,11 +570,11 @@ CoastMap::load(const std::string& dir)
                 for (int dir = 0; dir < 8; dir++) {
                     int di = dir_x[dir];
                     int dj = dir_y[dir];
-                    if (is_water_pix(i - 2 * di, j - 2 * dj)
-                        && is_water_pix(i - di, j - dj)
-                        && (!is_water_pix(i + di, j + dj)               // check 3 steps for ANY land
-                            || !is_water_pix(i + 2 * di, j + 2 * dj)    // works better with fjords
-                            || !is_water_pix(i + 3 * di, j + 3 * dj))) {
+                    if (is_water(i - 2 * di, j - 2 * dj)
+                        && is_water(i - di, j - dj)
+                        && (!is_water(i + di, j + dj)               // check 3 steps for ANY land
+                            || !is_water(i + 2 * di, j + 2 * dj)    // works better with fjords
+                            || !is_water(i + 3 * di, j + 3 * dj))) {
 
                         float f = 1.0f;
                         if (dir & 1)
@@ -290,40 +598,498 @@ CoastMap::load(const std::string& dir)
                         dir_land = 0;
                     }
 
-                    wmap_[idx] = (uint8_t)((dir_land << kDirShift) | sCoast);
+                    wmap[idx] = (uint8_t)((dir_land << kDirShift) | sCoast);
                 }
+            } else {
+                wmap[idx] = sLand;
+            }
+        }
+    }
+}
 
-                // steps must fit in 4 bits,  1 step ~ 7 km
-                // We are working in the ll-system here but we want the nearest point to land in the
-                // metric system. The metric distance of a delta ll in lon direction is smaller by a
-                // factor of cos(lat) than in lat direction.
-                // We therefore sort the directions by resulting metric distance = (lon, lat, diagonal)
-                static const std::array<int, 8> dir_weighted{0, 4, 2, 6, 1, 3, 5, 7};
-                for (int steps = 1; steps < 10; steps++) {
-                    for (int dir : dir_weighted) {
-                       // probe location, steps in direction dir
-                        int s = steps;
-                        if (!is_water_pix(i + s * dir_x[dir], j + s * dir_y[dir])) {
-                            // If the next higher step is still land we take that one.
-                            // Gives better results with small islands in front of the shoreline
-                            if (!is_water_pix(i + (s + 1) * dir_x[dir], j + (s + 1) * dir_y[dir]))
-                                s++;
-
-                            nearest_land_[idx] = (uint8_t)((dir << kDirShift) | s);
-                            // double break
-                            goto have_nearest_land;
-                        }
-                    }
-               }
+//------------------------------------------------------------------------------------
+// Nearest land by an exact Euclidean distance transform (Felzenszwalb & Huttenlocher)
+// in coast map coordinates.
+// As in the DepthMap the metric distance of a step in lon direction is cos(lat) of a
+// step in lat direction. That is a constant weight per row so the transform stays exact.
+//
+static constexpr int kNoLand = -128;            // in the column pass
+static constexpr int kMaxOffset = 127;          // dx, dy are int8_t
+static constexpr float kMaxLandDist = 100.0e3f; // m, beyond that we don't look for land
+
+// water in coast map coordinates, the image (0,0) is top left and lon 0 = center
+static inline bool
+IsWaterCm(const WaterMask& mask, int i_cm, int j_cm)
+{
+    int i = i_cm + mask.width / 2;
+    if (i >= mask.width)
+        i -= mask.width;
+    return mask.is_water(i, mask.height - j_cm);
+}
 
-              have_nearest_land:
-                continue;   // keep the compiler happy with c++20
+// col_dy[j * width + i] = row offset to the nearest land in column i or kNoLand
+template<typename F>
+static void
+ColumnPass(F is_land, int width, int height, int8_t *col_dy)
+{
+    std::vector<int> last(width, -1000000);      // row of last land seen
 
-            } else {
-                wmap_[idx] = sLand;
+    // upwards, nearest land below
+    for (int j = 0; j < height; j++) {
+        int8_t *row = col_dy + (size_t)j * width;
+        for (int i = 0; i < width; i++) {
+            if (is_land(i, j))
+                last[i] = j;
+            int d = j - last[i];
+            row[i] = d <= kMaxOffset ? -d : kNoLand;
+        }
+    }
+
+    // downwards, nearest land above if nearer
+    std::fill(last.begin(), last.end(), 1000000);
+    for (int j = height - 1; j >= 0; j--) {
+        int8_t *row = col_dy + (size_t)j * width;
+        for (int i = 0; i < width; i++) {
+            if (row[i] == 0)
+                last[i] = j;
+            int d = last[i] - j;
+            if (d <= kMaxOffset && (row[i] == kNoLand || d < -row[i]))
+                row[i] = d;
+        }
+    }
+}
+
+// Nearest land for the water pixels of rows [j_begin, j_end).
+// Row j is at latitude lat_0 + j * resolution, rows wrap around in lon direction if 'wrap'.
+static void
+NearestLand(const int8_t *col_dy, int width, bool wrap, float lat_0, float resolution, int j_begin, int j_end,
+            const uint8_t *wmap, int8_t *nearest_land)
+{
+    // the row extended by kMaxOffset on each side for the wrap around
+    int q_begin = wrap ? -kMaxOffset : 0;
+    int q_end = wrap ? width + kMaxOffset : width;
+    int n = q_end - q_begin;
+    std::vector<int> v(n);              // columns of the parabolas of the lower envelope
+    std::vector<double> z(n + 1);       // boundaries between them
+
+    float max_dist = kMaxLandDist / (kLat2m * resolution);    // in lat steps
+    double max_d2 = max_dist * max_dist;
+
+    for (int j = j_begin; j < j_end; j++) {
+        const int8_t *dy_row = col_dy + (size_t)j * width;
+        double w = cosf((lat_0 + j * resolution) * kD2R);
+        double w2 = w * w;
+
+        auto dy_at = [&](int q) {
+            if (q < 0)
+                q += width;
+            else if (q >= width)
+                q -= width;
+            return dy_row[q];
+        };
+
+        // f(q)/w² of the parabola at q
+        auto g = [&](int q) { double dy = dy_at(q); return dy * dy / w2; };
+
+        // lower envelope
+        int k = -1;
+        for (int q = q_begin; q < q_end; q++) {
+            if (dy_at(q) == kNoLand)
+                continue;
+
+            double s = 0.0;
+            while (k >= 0) {
+                int p = v[k];
+                s = ((g(q) + (double)q * q) - (g(p) + (double)p * p)) / (2.0 * (q - p));
+                if (s > z[k])
+                    break;
+                k--;
+            }
+
+            k++;
+            v[k] = q;
+            z[k] = (k == 0) ? -HUGE_VAL : s;
+            z[k + 1] = HUGE_VAL;
+        }
+
+        if (k < 0)
+            continue;   // no land in range at all
+
+        k = 0;
+        for (int i = 0; i < width; i++) {
+            while (z[k + 1] < i)
+                k++;
+
+            int idx = j * width + i;
+            if ((wmap[idx] & kItemMask) == sLand)
+                continue;
+
+            int q = v[k];
+            int dx = q - i;
+            int dy = dy_at(q);
+            if (std::abs(dx) <= kMaxOffset && w2 * dx * dx + dy * dy <= max_d2) {
+                nearest_land[2 * idx] = dx;
+                nearest_land[2 * idx + 1] = dy;
             }
         }
     }
+}
+
+bool
+CoastMap::decode_png(const std::string& png, const std::string& filename)
+{
+    spng_ctx* ctx = spng_ctx_new(0);
+    if(ctx == nullptr)
+        return false;
+
+    // Ignore and don't calculate chunk CRC's
+    spng_set_crc_action(ctx, SPNG_CRC_USE, SPNG_CRC_USE);
+
+    // Set memory usage limits for storing standard and unknown chunks,
+    // this is important when reading untrusted files!
+    size_t limit = 1024 * 1024 * 10;
+    spng_set_chunk_limits(ctx, limit, limit);
+
+    // Set source buffer
+    spng_set_png_buffer(ctx, png.data(), png.size());
+
+    struct spng_ihdr ihdr;
+    int ret = spng_get_ihdr(ctx, &ihdr);
+    if (ret) {
+        LogMsg("spng_get_ihdr() error: %s\n", spng_strerror(ret));
+        spng_ctx_free(ctx);
+        return false;
+    }
+
+    width_ = ihdr.width;
+    height_ = ihdr.height;
+    int color_type = ihdr.color_type;
+    int bit_depth = ihdr.bit_depth;
+
+    LogMsg("w: %d, h: %d, color_type: %d, bit_depth: %d", width_, height_, color_type, bit_depth);
+
+    resolution_ = 360.0f / width_;
+    if ((resolution_ != 180.0f / height_) || bit_depth != 8) {
+        LogMsg("Invalid map");
+        spng_ctx_free(ctx);
+        return false;
+    }
+
+    // progressive decoding delivers the rows in order only for non interlaced images
+    if (ihdr.interlace_method != SPNG_INTERLACE_NONE) {
+        LogMsg("Invalid map, interlaced png is not supported");
+        spng_ctx_free(ctx);
+        return false;
+    }
+
+    // decode row by row into the water mask
+    WaterMask mask(width_, height_);
+    auto rgba_row = std::make_unique<uint8_t[]>(4 * width_);
+    ret = spng_decode_image(ctx, nullptr, 0, SPNG_FMT_RGBA8, SPNG_DECODE_PROGRESSIVE);
+    while (ret == 0) {
+        struct spng_row_info ri;
+        ret = spng_get_row_info(ctx, &ri);
+        if (ret)
+            break;
+
+        ret = spng_decode_row(ctx, rgba_row.get(), 4 * width_);
+
+        if (ret == 0 || ret == SPNG_EOI)
+            mask.set_row(ri.row_num, rgba_row.get());
+    }
+    spng_ctx_free(ctx);
+
+    if (ret != SPNG_EOI) {
+        LogMsg("spng_decode_row() error: %s\n", spng_strerror(ret));
+        return false;
+    }
+
+    mask.fill_halo_rows();
+    LogMsg("Decoded: '%s', %s", filename.c_str(), "PNG");
+
+    // classify into dense local arrays that are packed when complete
+    auto wmap = std::make_unique<uint8_t[]>(height_ * width_);
+    auto nearest_land = std::make_unique<int8_t[]>(2 * height_ * width_);
+    auto col_dy = std::make_unique<int8_t[]>(height_ * width_);
+    auto is_water = [&mask](int i, int j) { return IsWaterCm(mask, i, j); };
+    ColumnPass([&mask](int i, int j) { return !IsWaterCm(mask, i, j); }, width_, height_, col_dy.get());
+
+    // rows are independent, classify bands of rows in parallel
+    // stay away from the poles
+    static constexpr int kPoleRows = 10;
+    int n_threads = std::clamp((int)std::thread::hardware_concurrency(), 1, 8);
+    int n_rows = height_ - 2 * kPoleRows;
+    auto band = [&](int t) {
+        int j_begin = kPoleRows + t * n_rows / n_threads;
+        int j_end = kPoleRows + (t + 1) * n_rows / n_threads;
+        Classify(is_water, width_, j_begin, j_end, wmap.get());
+        NearestLand(col_dy.get(), width_, true, -90.0f, resolution_, j_begin, j_end, wmap.get(), nearest_land.get());
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 1; t < n_threads; t++)
+        threads.emplace_back(band, t);
+
+    band(0);
+    for (auto& t : threads)
+        t.join();
+
+    LogMsg("Classified using %d threads", n_threads);
 
+    col_dy = nullptr;
+    grid_.pack(width_, height_, wmap.get(), nearest_land.get());
+    cache_ = nullptr;
+    LogMsg("Coast map packed: %d cells, %d coast, %d nearest land, %0.1f MB", width_ * height_,
+           (int)grid_.n_coast_, (int)grid_.n_nl_, grid_.size_ / 1048576.0);
     return true;
 }
+
+//------------------------------------------------------------------------------------
+// Tiles of a higher resolution coast dataset in <dir>/coast_tiles.
+// A tile is a 1°x1° png named like X-Plane's dsf files after its SW corner, e.g. +50+010.png.
+// It is square with any # of pixels per degree and uses the same colors as the global map.
+//
+static constexpr int kMinTileN = 16;
+static constexpr int kMaxTileN = 8192;
+
+// the tile is classified with a margin that is filled from the global map
+static constexpr int kTileMargin = kMaxOffset;
+
+int
+CoastTile::ll_2_idx(float lon, float lat) const
+{
+    int i = std::clamp((int)((lon - lon_0_) * n_), 0, n_ - 1);
+    int j = std::clamp((int)((lat - lat_0_) * n_), 0, n_ - 1);
+    return j * n_ + i;
+}
+
+// lon in the external world
+const CoastTile *
+CoastMap::find_tile(float lon, float lat) const
+{
+    if (tiles_.empty())
+        return nullptr;
+
+    if (lon >= 180.0f)
+        lon -= 360.0f;
+
+    auto it = tiles_.find(tile_key((int)floorf(lon), (int)floorf(lat)));
+    return it != tiles_.end() ? it->second.get() : nullptr;
+}
+
+std::unique_ptr<CoastTile>
+CoastMap::load_tile(int lon_0, int lat_0) const
+{
+    char name[20];
+    snprintf(name, sizeof(name), "%+03d%+04d.png", lat_0, lon_0);
+    std::string filename = tile_dir_ + "/" + name;
+
+    std::string png;
+    {
+        std::ifstream f(filename, std::ios::binary);
+        if (!f.is_open())
+            return nullptr;     // not an error, the dataset may not cover the world
+
+        png.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+    }
+
+    spng_ctx* ctx = spng_ctx_new(0);
+    if (ctx == nullptr)
+        return nullptr;
+
+    size_t limit = 1024 * 1024 * 10;
+    spng_set_chunk_limits(ctx, limit, limit);
+    spng_set_png_buffer(ctx, png.data(), png.size());
+
+    struct spng_ihdr ihdr;
+    int ret = spng_get_ihdr(ctx, &ihdr);
+    if (ret || ihdr.width != ihdr.height || ihdr.width < kMinTileN || ihdr.width > kMaxTileN) {
+        LogMsg("Invalid coast tile '%s'", filename.c_str());
+        spng_ctx_free(ctx);
+        return nullptr;
+    }
+
+    if (ihdr.interlace_method != SPNG_INTERLACE_NONE) {
+        LogMsg("Invalid coast tile '%s', interlaced png is not supported", filename.c_str());
+        spng_ctx_free(ctx);
+        return nullptr;
+    }
+
+    // the tile + margin in coast map coordinates, pixel centers are at +0.5
+    int n = ihdr.width;
+    int m = n + 2 * kTileMargin;
+    WaterMask mask(m, m);
+
+    // decode row by row into the water mask, (0,0) is top left
+    auto rgba_row = std::make_unique<uint8_t[]>(4 * n);
+    ret = spng_decode_image(ctx, nullptr, 0, SPNG_FMT_RGBA8, SPNG_DECODE_PROGRESSIVE);
+    while (ret == 0) {
+        struct spng_row_info ri;
+        ret = spng_get_row_info(ctx, &ri);
+        if (ret)
+            break;
+
+        ret = spng_decode_row(ctx, rgba_row.get(), 4 * n);
+
+        if (ret == 0 || ret == SPNG_EOI) {
+            int j = kTileMargin + n - 1 - ri.row_num;
+            for (int ti = 0; ti < n; ti++) {
+                const uint8_t *p = &rgba_row[4 * ti];
+                if ((p[0] | p[1] | p[2]) == 0)
+                    mask.set_water(kTileMargin + ti, j);
+            }
+        }
+    }
+    spng_ctx_free(ctx);
+
+    if (ret != SPNG_EOI) {
+        LogMsg("Can't decode coast tile '%s': %s", filename.c_str(), spng_strerror(ret));
+        return nullptr;
+    }
+
+    auto tile = std::make_unique<CoastTile>();
+    tile->lon_0_ = lon_0;
+    tile->lat_0_ = lat_0;
+    tile->n_ = n;
+    tile->resolution_ = 1.0f / n;
+
+    // fill the margin from the global map
+    for (int j = 0; j < m; j++) {
+        int tj = j - kTileMargin;
+        for (int i = 0; i < m; i++) {
+            int ti = i - kTileMargin;
+            if (0 <= ti && ti < n && 0 <= tj && tj < n)
+                continue;
+
+            float lon = lon_0 + (ti + 0.5f) * tile->resolution_;
+            float lat = lat_0 + (tj + 0.5f) * tile->resolution_;
+            if (grid_.state(ll_2_idx(lon, lat)) != sLand)
+                mask.set_water(i, j);
+        }
+    }
+
+    auto is_water = [&mask, m](int i, int j) {
+        return mask.is_water(std::clamp(i, 0, m - 1), std::clamp(j, 0, m - 1));
+    };
+
+    auto wmap = std::make_unique<uint8_t[]>((size_t)m * m);
+    auto nearest_land = std::make_unique<int8_t[]>(2 * (size_t)m * m);
+    auto col_dy = std::make_unique<int8_t[]>((size_t)m * m);
+    ColumnPass([&is_water](int i, int j) { return !is_water(i, j); }, m, m, col_dy.get());
+    Classify(is_water, m, kTileMargin, kTileMargin + n, wmap.get());
+    NearestLand(col_dy.get(), m, false, lat_0 + (0.5f - kTileMargin) * tile->resolution_, tile->resolution_,
+                kTileMargin, kTileMargin + n, wmap.get(), nearest_land.get());
+
+    // strip the margin
+    auto t_wmap = std::make_unique<uint8_t[]>((size_t)n * n);
+    auto t_nearest_land = std::make_unique<int8_t[]>(2 * (size_t)n * n);
+    for (int j = 0; j < n; j++) {
+        size_t src = (size_t)(j + kTileMargin) * m + kTileMargin;
+        memcpy(&t_wmap[(size_t)j * n], &wmap[src], n);
+        memcpy(&t_nearest_land[2 * (size_t)j * n], &nearest_land[2 * src], 2 * n);
+    }
+
+    tile->grid_.pack(n, n, t_wmap.get(), t_nearest_land.get());
+    LogMsg("Coast tile '%s' loaded: %d x %d, %0.1f KB", name, n, n, tile->grid_.size_ / 1024.0);
+    return tile;
+}
+
+bool
+CoastMap::update_tiles(float lon, float lat)
+{
+    if (tile_dir_.empty())
+        return false;
+
+    bool changed = false;
+    use_counter_++;
+
+    // collect a finished load
+    if (tile_future_.valid()
+        && std::future_status::ready == tile_future_.wait_for(std::chrono::seconds::zero())) {
+        auto tile = tile_future_.get();
+        if (tile) {
+            tile->last_used_ = use_counter_;
+            tiles_size_ += tile->grid_.size_;
+            tiles_[pending_tile_] = std::move(tile);
+            changed = true;
+        } else
+            missing_tiles_.insert(pending_tile_);
+
+        pending_tile_ = -1;
+    }
+
+    if (lon >= 180.0f)
+        lon -= 360.0f;
+
+    // touch the tiles within the radius and request the nearest one that is not loaded yet
+    float d_lat = tile_radius_ / kLat2m;
+    float cos_lat = std::max(cosf(lat * kD2R), 0.01f);
+    float d_lon = std::min(d_lat / cos_lat, 180.0f);
+    int lat_lo = std::max((int)floorf(lat - d_lat), -90);
+    int lat_hi = std::min((int)floorf(lat + d_lat), 89);
+    int lon_lo = (int)floorf(lon - d_lon);
+    int lon_hi = std::min((int)floorf(lon + d_lon), lon_lo + 359);
+
+    int want_lon = 0, want_lat = 0;
+    float want_d2 = HUGE_VALF;
+    for (int la = lat_lo; la <= lat_hi; la++) {
+        for (int lo = lon_lo; lo <= lon_hi; lo++) {
+            int lon_0 = lo;
+            if (lon_0 < -180)
+                lon_0 += 360;
+            else if (lon_0 >= 180)
+                lon_0 -= 360;
+
+            int key = tile_key(lon_0, la);
+            auto it = tiles_.find(key);
+            if (it != tiles_.end()) {
+                it->second->last_used_ = use_counter_;
+                continue;
+            }
+
+            if (key == pending_tile_ || missing_tiles_.count(key))
+                continue;
+
+            // to the tile's center
+            float dx = (lo + 0.5f - lon) * cos_lat;
+            float dy = la + 0.5f - lat;
+            if (dx * dx + dy * dy < want_d2) {
+                want_d2 = dx * dx + dy * dy;
+                want_lon = lon_0;
+                want_lat = la;
+            }
+        }
+    }
+
+    // one load at a time
+    if (want_d2 < HUGE_VALF && !tile_future_.valid()) {
+        pending_tile_ = tile_key(want_lon, want_lat);
+        tile_future_ = std::async(std::launch::async,
+                                  [this, want_lon, want_lat] { return load_tile(want_lon, want_lat); });
+    }
+
+    // evict the least recently used tiles beyond the budget but never the ones in use
+    while (tiles_size_ > tile_budget_) {
+        auto lru = tiles_.end();
+        for (auto it = tiles_.begin(); it != tiles_.end(); it++)
+            if (it->second->last_used_ != use_counter_
+                && (lru == tiles_.end() || it->second->last_used_ < lru->second->last_used_))
+                lru = it;
+
+        if (lru == tiles_.end())
+            break;
+
+        tiles_size_ -= lru->second->grid_.size_;
+        tiles_.erase(lru);
+        changed = true;
+    }
+
+    return changed;
+}
+
+void
+CoastMap::wait_tiles()
+{
+    if (tile_future_.valid())
+        tile_future_.wait();
+}
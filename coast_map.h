@@ -24,12 +24,101 @@
 #define _COAST_MAP_H_
 
 #include <tuple>
+#include <vector>
+#include <memory>
+#include <string>
+#include <future>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "mapped_file.h"
+
+// A grid of classified cells in packed form, most cells are plain water or land:
+// state_       2 bits per cell, 32 cells per word
+// coast_dir_   direction to land, one byte per coast cell
+// has_nl_      1 bit per cell, set if nearest_land_ has an entry, 64 cells per word
+// nearest_land_ pairs (dx, dy) of grid steps to the nearest land
+// The rank arrays hold the # of entries in front of a word, so the entry of a cell
+// is its word's rank + the popcount of the preceding cells in that word.
+struct PackedGrid {
+    int width_{0}, height_{0};
+    size_t n_coast_{0}, n_nl_{0};
+    size_t size_{0};                        // in bytes
+
+    // Storage is either owned or external, e.g. mapped read-only from a file
+    std::unique_ptr<uint64_t[]> buf_;
+    const uint64_t *state_{nullptr};
+    const uint64_t *has_nl_{nullptr};
+    const uint32_t *coast_rank_{nullptr};
+    const uint32_t *nl_rank_{nullptr};
+    const uint8_t *coast_dir_{nullptr};
+    const int8_t *nearest_land_{nullptr};
+
+    static size_t packed_size(size_t n, size_t n_coast, size_t n_nl);
+
+    // wmap and nearest_land are the dense arrays of the classification
+    void pack(int width, int height, const uint8_t *wmap, const int8_t *nearest_land);
+    void set(int width, int height, const uint8_t *data, size_t n_coast, size_t n_nl);
+    const uint8_t *data() const { return (const uint8_t *)state_; }
+
+    int state(int idx) const { return (state_[idx >> 5] >> (2 * (idx & 31))) & 3; }
+    int coast_dir(int idx) const;           // only for coast cells
+    bool nearest_land(int idx, int& dx, int& dy) const;     // -> has an entry
+};
+
+// A 1°x1° tile of a higher resolution coast dataset with n_ x n_ pixels.
+// It is classified with a margin so nearest land works across the tile border.
+struct CoastTile {
+    int lon_0_, lat_0_;         // SW corner
+    int n_;
+    float resolution_;          // = 1 / n_
+    uint32_t last_used_{0};     // for the LRU eviction
+    PackedGrid grid_;
+
+    int ll_2_idx(float lon, float lat) const;
+};
 
 struct CoastMap {
     int width_{0}, height_{0};
     float resolution_;
-    std::unique_ptr<uint8_t[]> wmap_;
-    std::unique_ptr<uint8_t[]> nearest_land_;
+
+    // the global map, storage is either owned or mapped read-only from the cache file
+    PackedGrid grid_;
+    std::unique_ptr<MappedFile> cache_;
+
+    // coast grid points of a DepthMap with kSnodResolution
+    struct CoastCell {
+        int16_t i, j;               // grid point
+        int8_t dir_x, dir_y;        // direction to land
+        bool water_1;               // is water 1 step in direction to land
+    };
+
+    std::vector<CoastCell> coast_cells_;
+    void index_coast(float resolution);     // from the global map only
+
+    // Tiles are optional, they are loaded in the background and then managed
+    // in the thread that calls update_tiles(), i.e. the flight loop. tiles_ is not locked,
+    // so all lookups that go through locate() must run in that thread, too.
+    // Other threads use the *_global() lookups.
+    std::string tile_dir_;                  // empty if there is no tile dataset
+    std::unordered_map<int, std::unique_ptr<CoastTile>> tiles_;
+    std::unordered_set<int> missing_tiles_;
+    std::future<std::unique_ptr<CoastTile>> tile_future_;
+    int pending_tile_{-1};
+    uint32_t use_counter_{0};
+    size_t tiles_size_{0};
+
+    static int tile_key(int lon_0, int lat_0) { return (lat_0 + 90) * 360 + (lon_0 + 180); }
+    const CoastTile *find_tile(float lon, float lat) const;
+    std::unique_ptr<CoastTile> load_tile(int lon_0, int lat_0) const;  // safe to run in parallel to lookups
+
+    // -> grid, idx into grid, resolution of grid; the tile if loaded otherwise the global map
+    std::tuple<const PackedGrid *, int, float> locate(float lon, float lat) const;
+
+    bool decode_png(const std::string& png, const std::string& filename);   // and classify the pixels
+    // the cache is keyed on crc32 and size of the png
+    bool load_cache(const std::string& fn, uint32_t png_crc, uint64_t png_size);
+    bool save_cache(const std::string& fn, uint32_t png_crc, uint64_t png_size) const;
 
     std::tuple<int, int> wrap_ij(int i, int j) const;
     int ij_2_idx(int i, int j) const;           // -> index into map
@@ -37,15 +126,32 @@ struct CoastMap {
     std::tuple<int, int> ll_2_ij(float lon, float lat) const;   // -> ll to ij
 
   public:
+    // budget for the tiles, the least recently used tiles beyond are evicted
+    size_t tile_budget_{64 * 1024 * 1024};
+    float tile_radius_{100.0e3f};           // m, tiles within are loaded
+
     bool load(const std::string& dir);
+    bool is_loaded() const { return grid_.state_ != nullptr; }
+    size_t mem_size() const { return grid_.size_; }       // of the global map in bytes
+    size_t tiles_mem_size() const { return tiles_size_; }
+    int n_tiles() const { return tiles_.size(); }
     bool is_water(float lon, float lat) const;
     bool is_land(float lon, float lat) const;
+    bool is_land_global(float lon, float lat) const;    // global map only, safe in any thread
 
     // -> yes_no, dir_x, dir_y, grid_angle
     std::tuple<bool, int, int, int> is_coast(float lon, float lat) const;
 
     // -> is_water, have_nl, lon, lat
     std::tuple<bool, bool, float, float> nearest_land(float lon, float lat) const;
+
+    // load tiles around the position and evict tiles beyond the budget
+    // -> a tile was added or evicted
+    bool update_tiles(float lon, float lat);
+    void wait_tiles();                      // for a pending tile load
+
+    // sorted by j, so a latitude band is a contiguous range
+    const std::vector<CoastCell>& coast_cells() const { return coast_cells_; }
 };
 
 extern CoastMap coast_map;
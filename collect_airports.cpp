@@ -22,10 +22,100 @@
 #include <cstring>
 #include <fstream>
 #include <filesystem>
+#include <string_view>
+#include <charconv>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <algorithm>
+#include <cstdarg>
 
 #include "airport.h"
+#include "mapped_file.h"
 
 std::vector<std::unique_ptr<Airport>> airports;
+AirportIndex airport_index;
+
+int AirportIndex::LonCell(float lon) {
+    int i = (int)floorf((lon + 180.0f) / kCell) % kNLon;
+    return i < 0 ? i + kNLon : i;
+}
+
+void AirportIndex::Build(const std::vector<std::unique_ptr<Airport>>& airports) {
+    airports_ = &airports;
+    buckets_.clear();
+    for (int i = 0; i < (int)airports.size(); i++) {
+        const LLPos& c = airports[i]->mec_center;
+        buckets_[LatCell(c.lat) * kNLon + LonCell(c.lon)].push_back(i);
+    }
+}
+
+AirportIndex::CellRange AirportIndex::Range(const LLPos& pos, float radius) {
+    // the cells that can hold a center within radius, with some slack for rounding
+    // a step in lon is shortest at the highest latitude of the range
+    float d_lat = 1.01f * radius / kLat2m;
+    float max_lat = std::min(fabsf(pos.lat) + d_lat, 90.0f);
+    float cos_lat = cosf(max_lat * kD2R);
+    CellRange r{LatCell(pos.lat - d_lat), LatCell(pos.lat + d_lat), 0, kNLon};
+    if (cos_lat > 0.01f) {
+        float d_lon = d_lat / cos_lat;
+        if (d_lon < 180.0f - kCell) {
+            r.i_lo = LonCell(pos.lon - d_lon);
+            r.n_i = (LonCell(pos.lon + d_lon) - r.i_lo + kNLon) % kNLon + 1;
+        }
+    }
+
+    return r;
+}
+
+int AirportIndex::FindFirst(const LLPos& pos, float radius) const {
+    if (airports_ == nullptr || buckets_.empty())
+        return -1;
+
+    auto [j_lo, j_hi, i_lo, n_i] = Range(pos, radius);
+    int first = -1;
+    for (int j = j_lo; j <= j_hi; j++) {
+        for (int k = 0; k < n_i; k++) {
+            auto it = buckets_.find(j * kNLon + (i_lo + k) % kNLon);
+            if (it == buckets_.end())
+                continue;
+
+            for (int i : it->second) {
+                if (first >= 0 && i >= first)
+                    break;      // ascending
+
+                if (len(pos - (*airports_)[i]->mec_center) < radius) {
+                    first = i;
+                    break;
+                }
+            }
+        }
+    }
+
+    return first;
+}
+
+void AirportIndex::FindAll(const LLPos& pos, float radius, std::vector<int>& result) const {
+    result.clear();
+    if (airports_ == nullptr || buckets_.empty())
+        return;
+
+    auto [j_lo, j_hi, i_lo, n_i] = Range(pos, radius);
+    for (int j = j_lo; j <= j_hi; j++) {
+        for (int k = 0; k < n_i; k++) {
+            auto it = buckets_.find(j * kNLon + (i_lo + k) % kNLon);
+            if (it == buckets_.end())
+                continue;
+
+            for (int i : it->second)
+                if (len(pos - (*airports_)[i]->mec_center) < radius)
+                    result.push_back(i);
+        }
+    }
+
+    std::sort(result.begin(), result.end());
+}
 
 // SceneryPacks constructor
 SceneryPacks::SceneryPacks(const std::string& xp_dir) {
@@ -73,229 +163,476 @@ SceneryPacks::SceneryPacks(const std::string& xp_dir) {
     sc_paths.shrink_to_fit();
 }
 
-static void SplitWords(std::string str, std::vector<std::string>& words) {
-    char* pch = strtok((char*)str.c_str(), " ");
-    while (pch != NULL) {
-        words.push_back(pch);
-        pch = strtok(NULL, " ");
+//------------------------------------------------------------------------------------
+// apt.dat scanner
+//
+// The file is mapped and parsed in place. Only row codes 1 and 100 are looked at,
+// other rows are skipped with memchr. A global airports style file can be
+// hundreds of MB so we stop at the 2nd airport header.
+//
+struct AptRow {
+    const char *p, *end;        // the row without '\r\n'
+
+    // -> next blank separated word, empty at the end of the row
+    std::string_view Word() {
+        while (p < end && *p == ' ')
+            p++;
+        const char *w = p;
+        while (p < end && *p != ' ')
+            p++;
+        return std::string_view(w, p - w);
     }
-}
+
+    bool SkipWords(int n) {
+        for (int i = 0; i < n; i++)
+            if (Word().empty())
+                return false;
+        return true;
+    }
+};
 
 // go through apt.dat and collect runways from 100 lines
 // only type 15 = transparent runway is collected
 // only one airport per apt.dat is processed (which is the 99.99% case)
-static std::unique_ptr<Airport> ParseAptDat(const std::string& fn) {
-    std::ifstream apt(fn);
-    if (apt.fail())
+std::unique_ptr<Airport> ParseAptDat(const std::string& fn) {
+    MappedFile apt;
+    if (!apt.Open(fn))
         return nullptr;
 
     auto arpt = std::make_unique<Airport>();
 
-    LogMsg("Processing '%s'", fn.c_str());
-
-    std::string line;
-    line.reserve(2000);  // can be quite long
+    const char *p = (const char *)apt.data();
+    const char *end = p + apt.size();
     bool have_airport = false;
 
-    while (std::getline(apt, line)) {
-        size_t i = line.find('\r');
-        if (i != std::string::npos)
-            line.resize(i);
+    for (const char *eol; p < end; p = eol + 1) {
+        eol = (const char *)memchr(p, '\n', end - p);
+        if (eol == nullptr)
+            eol = end;
+
+        int code;
+        auto [q, ec] = std::from_chars(p, eol, code);
+        if (ec != std::errc() || q == eol || *q != ' ' || (code != 1 && code != 100))
+            continue;
+
+        AptRow row{q, eol};
+        if (row.end > row.p && row.end[-1] == '\r')
+            row.end--;
 
         // 1    681 0 0 ENGM Oslo Gardermoen
-        if (line.starts_with("1 ")) {
-            // LogMsg("%s", line.c_str());
+        if (code == 1) {
             if (have_airport)
-                return arpt;  // only one airport per apt.dat
+                break;  // only one airport per apt.dat
 
             have_airport = true;
-
-            int ofs;
-            sscanf(line.c_str(), "%*d %*d %*d %*d %n", &ofs);
-            if (ofs < (int)line.size())
-                line.erase(0, ofs);
-            arpt->name = line;
+            if (row.SkipWords(3)) {
+                while (row.p < row.end && *row.p == ' ')
+                    row.p++;
+                arpt->name.assign(row.p, row.end);
+            }
             continue;
         }
 
         // 100 45.11 15 0 0.00 1 3 0 01L  60.18499584  011.07373840 0 148 3 1 0 0 19R  60.21615335  011.09170422 0 140 3
         // 2 1 0
-        if (line.starts_with("100 ")) {
-            std::vector<std::string> words;
-            SplitWords(line, words);
-            if (words.size() < 20)
-                continue;
+        Runway rwy;
+        if (!row.SkipWords(7))
+            continue;
+        rwy.name = row.Word();
+        if (!ToFloat(row.Word(), rwy.end1.lat) || !ToFloat(row.Word(), rwy.end1.lon) || !row.SkipWords(7)
+            || !ToFloat(row.Word(), rwy.end2.lat) || !ToFloat(row.Word(), rwy.end2.lon))
+            continue;
 
-            Runway rwy;
-            rwy.name = words[8];
-            rwy.end1.lat = std::atof(words[9].c_str());
-            rwy.end1.lon = std::atof(words[10].c_str());
-            rwy.end2.lat = std::atof(words[18].c_str());
-            rwy.end2.lon = std::atof(words[19].c_str());
-            arpt->runways.push_back(rwy);
-        }
+        arpt->runways.push_back(rwy);
     }
 
-    apt.close();
     return arpt;
 }
 
-struct Circle {
-    Vec2 c;
-    float r;
-};
+// The scan workers don't log directly but collect the messages of a pack. They are
+// logged by the calling thread when all workers are done, so the lines of a pack stay
+// together and the packs appear in scenery_packs.ini order.
+static void AppendLog(std::vector<std::string>& log, const char *fmt, ...) {
+    char buf[512];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    log.push_back(buf);
+}
 
 // circle from 2 points
 static Circle CircleFrom(const Vec2& a, const Vec2& b) {
     return {0.5f * (a + b), 0.5f * len(a - b)};
 }
 
-// circle from 3 points
+// circle through 3 points
+// for (nearly) collinear points the circle around the 2 most distant ones
 static Circle CircleFrom(const Vec2& v1, const Vec2& v2, const Vec2& v3) {
-    // Check whether a circle around 2 points covers the third one.
-    // It's cheap and covers the case that all 3 are collinear
-    Circle c = CircleFrom(v1, v2);
-    if (len(v3 - c.c) <= c.r)
-        return c;
-
-    c = CircleFrom(v1, v3);
-    if (len(v2 - c.c) <= c.r)
-        return c;
-
-    c = CircleFrom(v2, v3);
-    if (len(v1 - c.c) <= c.r)
-        return c;
-
     Vec2 v21 = v2 - v1;
     Vec2 v31 = v3 - v1;
+    float D = v21.x * v31.y - v31.x * v21.y;
 
-    float lv1 = v1.x * v1.x + v1.y * v1.y;
-    float lv2 = v2.x * v2.x + v2.y * v2.y;
-    float lv3 = v3.x * v3.x + v3.y * v3.y;
+    float l21 = len(v21), l31 = len(v31), l32 = len(v3 - v2);
+    if (fabsf(D) <= 1.0e-6f * std::max({l21 * l31, l21 * l32, l31 * l32})) {
+        if (l21 >= l31 && l21 >= l32)
+            return CircleFrom(v1, v2);
+        return l31 >= l32 ? CircleFrom(v1, v3) : CircleFrom(v2, v3);
+    }
 
-    Vec2 d{0.5f * (lv2 - lv1), 0.5f * (lv3 - lv1)};
-    float D = v21.x * v31.y - v31.x * v21.y;
-    Vec2 cc{(d.x * v31.y - d.y * v21.y) / D, (v21.x * d.y - v31.x * d.x) / D};
-    return {cc, len(v1 - cc)};
+    // relative to v1 for precision
+    float lv2 = 0.5f * (v21.x * v21.x + v21.y * v21.y);
+    float lv3 = 0.5f * (v31.x * v31.x + v31.y * v31.y);
+    Vec2 cc{(lv2 * v31.y - lv3 * v21.y) / D, (v21.x * lv3 - v31.x * lv2) / D};
+    return {v1 + cc, len(cc)};
 }
 
-static Circle min_circle_trivial(std::vector<Vec2>& P) {
-    if (P.empty())
+// Welzl's algorithm for the MEC, iterative with move to front
+//
+// The boundary of a circle is defined by at most 3 points, these are
+// P[i], P[j], P[k] of the loops below, so no recursion and no boundary set is needed.
+// Expected O(n) for a random order. The order is shuffled with a fixed seed
+// so the result does not depend on anything else.
+Circle MinEnclosingCircle(std::vector<Vec2>& P) {
+    static constexpr float kEps = 1.0e-3f;     // m, don't chase rounding errors
+    static constexpr unsigned kSeed = 4711;
+
+    int n = P.size();
+    if (n == 0)
         return {{0, 0}, 0};
 
-    if (P.size() == 1)
-        return {P[0], 0};
+    std::mt19937 rng(kSeed);
+    std::shuffle(P.begin(), P.end(), rng);
+
+    auto inside = [](const Circle& c, const Vec2& p) { return len(p - c.c) <= c.r + kEps; };
+
+    Circle c{P[0], 0};
+    for (int i = 1; i < n; i++) {
+        if (inside(c, P[i]))
+            continue;
+
+        // P[i] is on the boundary of the MEC of P[0..i]
+        c = {P[i], 0};
+        for (int j = 0; j < i; j++) {
+            if (inside(c, P[j]))
+                continue;
+
+            // P[i], P[j] are on the boundary, so is P[k] if it is outside
+            c = CircleFrom(P[i], P[j]);
+            for (int k = 0; k < j; k++)
+                if (!inside(c, P[k]))
+                    c = CircleFrom(P[i], P[j], P[k]);
+        }
+
+        // move to front, points that extend the circle tend to be extreme
+        std::rotate(P.begin(), P.begin() + i, P.begin() + i + 1);
+    }
+
+    return c;
+}
+
+// runs in the scan workers, so it logs to the pack's log
+static void ComputeMEC(Airport& arpt, std::vector<std::string>& log) {
+    AppendLog(log, "%s", arpt.name.c_str());
+    std::vector<Vec2> rwy_ends;
+
+    LLPos base = arpt.runways[0].end1;  // pick arbitrary base for circle computation
+    for (auto& rw : arpt.runways) {
+        AppendLog(log, "  rw: %-3s, end1: (%0.4f, %0.4f), end2: (%0.4f, %0.4f)", rw.name.c_str(), rw.end1.lat,
+                  rw.end1.lon, rw.end2.lat, rw.end2.lon);
+        rwy_ends.push_back(rw.end1 - base);
+        rwy_ends.push_back(rw.end2 - base);
+    }
 
-    if (P.size() == 2)
-        return CircleFrom(P[0], P[1]);
+    Circle c = MinEnclosingCircle(rwy_ends);
 
-    return CircleFrom(P[0], P[1], P[2]);
+    arpt.mec_center = base + c.c;
+    arpt.mec_radius = c.r;
+    AppendLog(log, "    center: (%0.4f, %0.4f), r = %0.1f", arpt.mec_center.lat, arpt.mec_center.lon,
+              arpt.mec_radius);
 }
 
-// Welzl's algorithm for the MEC
+//------------------------------------------------------------------------------------
+// Scanning scenery packs
 //
-// P = set of points
-// R = set of boundary points
-// n = # of points in P
-static Circle Welzl(std::vector<Vec2>& P, std::vector<Vec2> R, int n) {
-    // Base case when all points processed or |R| = 3
-    if (n == 0 || R.size() == 3) {
-        return min_circle_trivial(R);
-    }
+// Only few packs have a xa-snow.cfg. For those the results are cached in output_dir/airports.cache
+// and reused as long as path, size and mtime of xa-snow.cfg and apt.dat are unchanged.
+// The cache also keeps the elevations probed in the sim, see SaveAirportsCache().
+//
+struct FileStamp {
+    int64_t size{-1};           // -1 = does not exist
+    int64_t mtime{0};
 
-    // Pick a random point
-    int idx = rand() % n;
-    Vec2 p = P[idx];
+    bool operator==(const FileStamp&) const = default;
+};
+
+static FileStamp Stamp(const std::string& fn) {
+    std::error_code ec;
+    FileStamp fs;
+    auto size = std::filesystem::file_size(fn, ec);
+    if (ec)
+        return fs;
+
+    auto mtime = std::filesystem::last_write_time(fn, ec);
+    if (ec)
+        return fs;
+
+    fs.size = size;
+    fs.mtime = mtime.time_since_epoch().count();
+    return fs;
+}
+
+struct PackScan {
+    FileStamp cfg, apt;
+    std::unique_ptr<Airport> arpt;      // nullptr = not a valid legacy airport
+    int idx{-1};                        // into airports once collected
+    float elevation{Airport::kNoElevation};     // as written to the cache
+    std::vector<std::string> log;       // of the scan, see AppendLog()
+};
 
-    // Put the picked point at the end of P
-    // since it's more efficient than
-    // deleting from the middle of the vector
-    std::swap(P[idx], P[n - 1]);
+// the scan of the last CollectAirports(), to write back probed elevations
+static std::string cache_fn;
+static std::vector<std::string> pack_paths;
+static std::vector<PackScan> pack_scans;
+
+static constexpr char kCacheName[] = "airports.cache";
+static constexpr int kMaxRunways = 50;      // the cap is arbitrary, the MEC is O(n)
+static constexpr char kCacheHeader[] = "xa-snow airports cache 3";      // bump whenever the results change
+
+// P <cfg size> <cfg mtime> <apt size> <apt mtime> <valid> <max_snow_depth> <mec lon> <mec lat> <mec radius> <elevation>
+//   <# rwys> <path>                                        on one line
+// N <airport name>                                         if valid
+// R <name> <end1 lat> <end1 lon> <end2 lat> <end2 lon>     for each runway
+static std::unordered_map<std::string, PackScan> LoadCache(const std::string& fn) {
+    std::unordered_map<std::string, PackScan> cache;
+    std::ifstream f(fn);
+    std::string line;
+    if (!f.is_open() || !std::getline(f, line) || line != kCacheHeader)
+        return cache;
+
+    while (std::getline(f, line)) {
+        PackScan ps;
+        long long cfg_size, cfg_mtime, apt_size, apt_mtime;
+        int valid, n_rwy, ofs = -1;
+        float max_snow_depth, mec_lon, mec_lat, mec_radius, elevation;
+        if (11 != sscanf(line.c_str(), "P %lld %lld %lld %lld %d %f %f %f %f %f %d %n", &cfg_size, &cfg_mtime,
+                         &apt_size, &apt_mtime, &valid, &max_snow_depth, &mec_lon, &mec_lat, &mec_radius, &elevation,
+                         &n_rwy, &ofs)
+            || ofs < 0 || n_rwy < 0 || n_rwy > kMaxRunways)
+            goto invalid;
+
+        std::string path = line.substr(ofs);
+        ps.cfg = {cfg_size, cfg_mtime};
+        ps.apt = {apt_size, apt_mtime};
+        if (valid) {
+            ps.arpt = std::make_unique<Airport>();
+            ps.arpt->max_snow_depth = max_snow_depth;
+            ps.arpt->mec_center = {mec_lon, mec_lat};
+            ps.arpt->mec_radius = mec_radius;
+            ps.arpt->elevation = elevation;
+
+            if (!std::getline(f, line) || !line.starts_with("N "))
+                goto invalid;
+            ps.arpt->name = line.substr(2);
+
+            for (int i = 0; i < n_rwy; i++) {
+                char name[20];
+                Runway rwy;
+                if (!std::getline(f, line)
+                    || 5 != sscanf(line.c_str(), "R %19s %f %f %f %f", name, &rwy.end1.lat, &rwy.end1.lon,
+                                   &rwy.end2.lat, &rwy.end2.lon))
+                    goto invalid;
+                rwy.name = name;
+                ps.arpt->runways.push_back(rwy);
+            }
+        }
 
-    Circle d = Welzl(P, R, n - 1);
-    if (len(d.c - p) <= d.r)
-        return d;
+        cache[path] = std::move(ps);
+    }
 
-    // Otherwise, must be on the boundary of the MEC
-    R.push_back(p);
+    LogMsg("Loaded %d entries from '%s'", (int)cache.size(), fn.c_str());
+    return cache;
 
-    // Return the MEC for P - {p} and R U {p}
-    return Welzl(P, R, n - 1);
+  invalid:
+    LogMsg("Airports cache '%s' is invalid, ignored", fn.c_str());
+    cache.clear();
+    return cache;
 }
 
-bool CollectAirports(const std::string& xp_dir) {
-    SceneryPacks scp(xp_dir);
-    if (scp.sc_paths.size() == 0) {
-        LogMsg("Can't collect scenery_packs.ini");
+// after collecting, the airports are referenced by idx
+static bool SaveCache(const std::string& fn, const std::vector<std::string>& paths, std::vector<PackScan>& scans) {
+    // write to a temp file first so readers never see a partial file
+    std::string tmp_fn = fn + ".tmp";
+    FILE *f = fopen(tmp_fn.c_str(), "w");
+    if (f == nullptr) {
+        LogMsg("Can't create airports cache '%s'", tmp_fn.c_str());
         return false;
     }
 
-    airports.reserve(50);
-
-    for (auto& path : scp.sc_paths) {
-        std::ifstream cfg(path + "/xa-snow.cfg");
-        if (!cfg.is_open())
+    fprintf(f, "%s\n", kCacheHeader);
+    for (size_t i = 0; i < scans.size(); i++) {
+        PackScan& ps = scans[i];
+        if (ps.cfg.size < 0)
+            continue;   // the common case, nothing to remember
+
+        const Airport *arpt = ps.idx >= 0 ? airports[ps.idx].get() : nullptr;
+        fprintf(f, "P %lld %lld %lld %lld %d %.9g %.9g %.9g %.9g %.9g %d %s\n", (long long)ps.cfg.size,
+                (long long)ps.cfg.mtime, (long long)ps.apt.size, (long long)ps.apt.mtime, arpt != nullptr,
+                arpt ? arpt->max_snow_depth : 0.0f, arpt ? arpt->mec_center.lon : 0.0f,
+                arpt ? arpt->mec_center.lat : 0.0f, arpt ? arpt->mec_radius : 0.0f,
+                arpt ? arpt->elevation : Airport::kNoElevation, arpt ? (int)arpt->runways.size() : 0,
+                paths[i].c_str());
+        if (arpt == nullptr)
             continue;
 
-        LogMsg("Found xa-snow.cfg in '%s'", path.c_str());
-        float max_snow_depth = -1.0f;
-        std::string line;
-        while (std::getline(cfg, line)) {
-            if (line.starts_with("max_snow_depth=")) {
-                max_snow_depth = std::stof(line.substr(15));
-                LogMsg("  max_snow_depth: %0.3f m", max_snow_depth);
-                break;
-            }
-        }
-        cfg.close();
+        ps.elevation = arpt->elevation;
+        fprintf(f, "N %s\n", arpt->name.c_str());
+        for (auto& rw : arpt->runways)
+            fprintf(f, "R %s %.9g %.9g %.9g %.9g\n", rw.name.c_str(), rw.end1.lat, rw.end1.lon, rw.end2.lat,
+                    rw.end2.lon);
+    }
 
-        if (max_snow_depth < 0.0f) {
-            LogMsg("  no valid max_snow_depth found, skipping scenery pack");
-            continue;
-        }
+    bool ok = (0 == ferror(f));
+    ok = (0 == fclose(f)) && ok;
 
-        auto arpt = ParseAptDat(path + "Earth nav data/apt.dat");
-        if (arpt == nullptr || arpt->runways.size() == 0 || arpt->runways.size() > 10) {
-            LogMsg("  no valid  runways found, skipping scenery pack");
-            continue;
-        }
+    std::error_code ec;
+    if (ok)
+        std::filesystem::rename(tmp_fn, fn, ec);
 
-        arpt->max_snow_depth = max_snow_depth;
-        airports.push_back(std::move(arpt));
+    if (!ok || ec) {
+        LogMsg("Can't write airports cache '%s'", fn.c_str());
+        std::filesystem::remove(tmp_fn, ec);
+        return false;
     }
 
-    airports.shrink_to_fit();
+    return true;
+}
+
+// runs in parallel for many packs, cache is read only
+static PackScan ScanPack(const std::string& path, const std::unordered_map<std::string, PackScan>& cache) {
+    PackScan ps;
+    std::string cfg_name = path + "/xa-snow.cfg";
+    std::string apt_name = path + "Earth nav data/apt.dat";
 
-    LogMsg("Collected %d legacy airports", (int)airports.size());
+    ps.cfg = Stamp(cfg_name);
+    if (ps.cfg.size < 0)
+        return ps;
 
-    for (auto& arpt : airports) {
-        LogMsg("%s", arpt->name.c_str());
-        std::vector<Vec2> rwy_ends;
+    ps.apt = Stamp(apt_name);
 
-        LLPos base = arpt->runways[0].end1;  // pick arbitrary base for circle computation
-        for (auto& rw : arpt->runways) {
-            LogMsg("  rw: %-3s, end1: (%0.4f, %0.4f), end2: (%0.4f, %0.4f)", rw.name.c_str(), rw.end1.lat, rw.end1.lon,
-                   rw.end2.lat, rw.end2.lon);
-            rwy_ends.push_back(rw.end1 - base);
-            rwy_ends.push_back(rw.end2 - base);
+    auto it = cache.find(path);
+    if (it != cache.end() && it->second.cfg == ps.cfg && it->second.apt == ps.apt) {
+        if (it->second.arpt) {
+            ps.arpt = std::make_unique<Airport>(*it->second.arpt);
+            AppendLog(ps.log, "Found xa-snow.cfg in '%s', cached: '%s'", path.c_str(), ps.arpt->name.c_str());
         }
+        return ps;
+    }
 
-        Circle c;
-        if (rwy_ends.size() == 2)
-            c = CircleFrom(rwy_ends[0], rwy_ends[1]);
-        else
-            c = Welzl(rwy_ends, {}, rwy_ends.size());
+    std::ifstream cfg(cfg_name);
+    if (!cfg.is_open())
+        return ps;
+
+    AppendLog(ps.log, "Found xa-snow.cfg in '%s'", path.c_str());
+    float max_snow_depth = -1.0f;
+    std::string line;
+    while (std::getline(cfg, line)) {
+        if (line.starts_with("max_snow_depth=")) {
+            max_snow_depth = std::stof(line.substr(15));
+            AppendLog(ps.log, "  max_snow_depth: %0.3f m", max_snow_depth);
+            break;
+        }
+    }
+    cfg.close();
+
+    if (max_snow_depth < 0.0f) {
+        AppendLog(ps.log, "  no valid max_snow_depth found, skipping scenery pack");
+        return ps;
+    }
 
-        arpt->mec_center = base + c.c;
-        arpt->mec_radius = c.r;
-        LogMsg("    center: (%0.4f, %0.4f), r = %0.1f", arpt->mec_center.lat, arpt->mec_center.lon, arpt->mec_radius);
+    AppendLog(ps.log, "Processing '%s'", apt_name.c_str());
+    auto arpt = ParseAptDat(apt_name);
+    if (arpt == nullptr || arpt->runways.size() == 0 || arpt->runways.size() > kMaxRunways) {
+        AppendLog(ps.log, "  no valid  runways found, skipping scenery pack");
+        return ps;
     }
 
+    arpt->max_snow_depth = max_snow_depth;
+    ComputeMEC(*arpt, ps.log);
+    ps.arpt = std::move(arpt);
+    return ps;
+}
+
+bool CollectAirports(const std::string& xp_dir) {
+    SceneryPacks scp(xp_dir);
+    if (scp.sc_paths.size() == 0) {
+        LogMsg("Can't collect scenery_packs.ini");
+        return false;
+    }
+
+    cache_fn = output_dir + "/" + kCacheName;
+    auto cache = LoadCache(cache_fn);
+
+    // Mostly waiting for the file system, e.g. network storage,
+    // so use more threads than cores. The result keeps the order of scenery_packs.ini.
+    static constexpr int kScanThreads = 16;
+    int n_packs = scp.sc_paths.size();
+    std::vector<PackScan> scans(n_packs);
+    std::atomic<int> next{0};
+    auto worker = [&]() {
+        for (int i; (i = next++) < n_packs;)
+            scans[i] = ScanPack(scp.sc_paths[i], cache);
+    };
+
+    int n_threads = std::min(kScanThreads, n_packs);
+    std::vector<std::thread> threads;
+    for (int t = 1; t < n_threads; t++)
+        threads.emplace_back(worker);
+
+    worker();
+    for (auto& t : threads)
+        t.join();
+
+    for (auto& ps : scans) {
+        for (auto& msg : ps.log)
+            LogMsg("%s", msg.c_str());
+        ps.log = {};
+    }
+
+    airports.clear();
+    for (auto& ps : scans)
+        if (ps.arpt) {
+            ps.idx = airports.size();
+            airports.push_back(std::move(ps.arpt));
+        }
+
+    airports.shrink_to_fit();
+    SaveCache(cache_fn, scp.sc_paths, scans);
+    pack_paths = std::move(scp.sc_paths);
+    pack_scans = std::move(scans);
+    LogMsg("Collected %d legacy airports from %d scenery packs using %d threads", (int)airports.size(), n_packs,
+           n_threads);
+
+    airport_index.Build(airports);
     return true;
 }
 
+bool SaveAirportsCache() {
+    int n_new = 0;
+    for (auto& ps : pack_scans)
+        if (ps.idx >= 0 && airports[ps.idx]->elevation != ps.elevation)
+            n_new++;
+
+    if (n_new == 0)
+        return true;
+
+    LogMsg("Saving %d new airport elevations", n_new);
+    return SaveCache(cache_fn, pack_paths, pack_scans);
+}
+
 #ifdef TEST_AIRPORTS
 const char* log_msg_prefix = "collect_airports: ";
+std::string output_dir = ".";
 
 int main() {
     bool res = CollectAirports("e:/X-Plane-12-test");
@@ -23,6 +23,7 @@
 #include <fstream>
 #include <memory>
 #include <string>
+#include <algorithm>
 
 #include "xa-snow.h"
 #include "depth_map.h"
@@ -117,18 +118,29 @@ CreateSnowMapPng(DepthMap& snod_map, const std::string& png_path)
             float lon = i * kScale;
             float lat = j * kScale - 90.0f;
 
-            if (coast_map.is_land(lon, lat)) {
+            // runs in the download thread, so no tiles
+            if (coast_map.is_land_global(lon, lat)) {
                img[(kHeight - j - 1) * kWidth + xlate(i)] = pixel;
             }
         }
     }
 
-    // snow
-    for (int i = 0; i < kWidth; i++) {
-        for (int j = 0; j < kHeight; j++) {
-            float lon = i * 0.1f;
-            float lat = j * 0.1f - 90.0f;
-            auto [sd, is_extended] = snod_map.Get(lon, lat);
+    // snow, sampled row by row
+    auto lon_row = std::make_unique<float[]>(kWidth);
+    auto lat_row = std::make_unique<float[]>(kWidth);
+    auto sd_row = std::make_unique<float[]>(kWidth);
+    auto is_extended_row = std::make_unique<bool[]>(kWidth);
+    for (int i = 0; i < kWidth; i++)
+        lon_row[i] = i * 0.1f;
+
+    for (int j = 0; j < kHeight; j++) {
+        float lat = j * 0.1f - 90.0f;
+        std::fill_n(lat_row.get(), kWidth, lat);
+        snod_map.GetMany(kWidth, lon_row.get(), lat_row.get(), sd_row.get(), is_extended_row.get());
+
+        for (int i = 0; i < kWidth; i++) {
+            float sd = sd_row[i];
+            bool is_extended = is_extended_row[i];
             if (sd <= 0.01f)
                 continue;
 
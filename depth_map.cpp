@@ -21,28 +21,51 @@
 //
 
 #include <cstdio>
+#include <cstring>
 #include <cassert>
 #include <fstream>
 #include <string>
 #include <cmath>
 #include <memory>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <filesystem>
+
+#include <zlib.h>
 
 #include "xa-snow.h"
 #include "depth_map.h"
 #include "coast_map.h"
+#include "grib_decode.h"
+
+// AVX2 is selected at runtime
+#if (defined(__x86_64__) || defined(_M_X64)) && defined(__GNUC__)
+#define DEPTH_MAP_AVX2
+#include <immintrin.h>
+#endif
 
 int DepthMap::seqno_base_;
+int DepthMap::extend_threads_;
 
 DepthMap::DepthMap(float resolution) {
     seqno_ = ++seqno_base_;
     resolution_ = resolution;
-    width_ = 360.0f / resolution_;
-    height_ = (int)(180.0f / resolution_) + 1;
-    val_ = std::make_unique<float[]>(height_ * width_);
-    extended_snow_ = std::make_unique<bool[]>(height_ * width_);
+    SetSize(360.0f / resolution_, (int)(180.0f / resolution_) + 1);
+    val_buf_ = std::make_unique<float[]>(n_cells_);
+    extended_snow_buf_ = std::make_unique<bool[]>(n_cells_);
+    val_ = val_buf_.get();
+    extended_snow_ = extended_snow_buf_.get();
     LogMsg("DepthMap created: %d, width %d, height: %d", seqno_, width_, height_);
 }
 
+void DepthMap::SetSize(int width, int height) {
+    width_ = width;
+    height_ = height;
+    stride_ = width_ + 2;
+    n_cells_ = stride_ * (height_ + 2);
+}
+
 int DepthMap::MapIdx(int i_lon, int i_lat) const {
     // for lon we wrap around
     if (i_lon >= width_)
@@ -56,8 +79,8 @@ int DepthMap::MapIdx(int i_lon, int i_lat) const {
     else if (i_lat < 0)
         i_lat = 0;
 
-    int idx = i_lat * width_ + i_lon;
-    assert(0 <= idx && idx < width_ * height_);
+    int idx = Idx(i_lon, i_lat);
+    assert(0 <= idx && idx < n_cells_);
     return idx;
 }
 
@@ -82,15 +105,40 @@ std::tuple<float, bool> DepthMap::Get(float lon, float lat) const {
 
     // LogMsg("(%f, %f) -> (%d, %d) (%f, %f)", lon/10, lat/10 - 90, i_lon, i_lat, s, t)
 
-    int i00 = MapIdx(i_lon, i_lat);
-    int i10 = MapIdx(i_lon + 1, i_lat);
-    int i01 = MapIdx(i_lon, i_lat + 1);
-    int i11 = MapIdx(i_lon + 1, i_lat + 1);
+    int i00, i10, i01, i11;
+    if ((unsigned)i_lon < (unsigned)width_ && (unsigned)i_lat < (unsigned)height_) {
+        // the halo has the right and upper neighbors
+        i00 = Idx(i_lon, i_lat);
+        i10 = i00 + 1;
+        i01 = i00 + stride_;
+        i11 = i01 + 1;
+    } else {
+        i00 = MapIdx(i_lon, i_lat);
+        i10 = MapIdx(i_lon + 1, i_lat);
+        i01 = MapIdx(i_lon, i_lat + 1);
+        i11 = MapIdx(i_lon + 1, i_lat + 1);
+    }
 
-    float v00 = val_[i00];
-    float v10 = val_[i10];
-    float v01 = val_[i01];
-    float v11 = val_[i11];
+    float v00, v10, v01, v11;
+    bool es;
+    if (cval_) {
+        uint16_t c00 = cval_[i00];
+        uint16_t c10 = cval_[i10];
+        uint16_t c01 = cval_[i01];
+        uint16_t c11 = cval_[i11];
+
+        v00 = (c00 & kCompactMaxMm) * 0.001f;
+        v10 = (c10 & kCompactMaxMm) * 0.001f;
+        v01 = (c01 & kCompactMaxMm) * 0.001f;
+        v11 = (c11 & kCompactMaxMm) * 0.001f;
+        es = ((c00 | c10 | c01 | c11) & kCompactExtended) != 0;
+    } else {
+        v00 = val_[i00];
+        v10 = val_[i10];
+        v01 = val_[i01];
+        v11 = val_[i11];
+        es = extended_snow_[i00] || extended_snow_[i10] || extended_snow_[i01] || extended_snow_[i11];
+    }
 
     // Lagrange polynoms: pij = is 1 on corner ij and 0 elsewhere
     float p00 = (1 - s) * (1 - t);
@@ -101,126 +149,669 @@ std::tuple<float, bool> DepthMap::Get(float lon, float lat) const {
     float v = v00 * p00 + v10 * p10 + v01 * p01 + v11 * p11;
     // LogMsg("vij: %f, %f, %f, %f; v: %f", v00, v10, v01, v11, v)
 
-    bool es00 = extended_snow_[i00];
-    bool es10 = extended_snow_[i10];
-    bool es01 = extended_snow_[i01];
-    bool es11 = extended_snow_[i11];
-
-    bool es = es00 || es10 || es01 || es11;
     return std::tuple(v, es);
 }
 
+#ifdef DEPTH_MAP_AVX2
+// Helpers for GetManyAvx2(), same arithmetic as Get() and MapIdx() for 8 points
+
+__attribute__((target("avx2"))) static inline __m256i WrapLon(__m256i i_lon, __m256i width) {
+    __m256i ge = _mm256_cmpgt_epi32(i_lon, _mm256_sub_epi32(width, _mm256_set1_epi32(1)));
+    i_lon = _mm256_sub_epi32(i_lon, _mm256_and_si256(ge, width));
+    __m256i lt = _mm256_cmpgt_epi32(_mm256_setzero_si256(), i_lon);
+    return _mm256_add_epi32(i_lon, _mm256_and_si256(lt, width));
+}
+
+// confine to [-1, height - 1], the halo rows duplicate the pole rows
+__attribute__((target("avx2"))) static inline __m256i ClampLat(__m256i i_lat, __m256i height) {
+    i_lat = _mm256_min_epi32(i_lat, _mm256_sub_epi32(height, _mm256_set1_epi32(1)));
+    return _mm256_max_epi32(i_lat, _mm256_set1_epi32(-1));
+}
+
+// compact cell -> snow depth
+__attribute__((target("avx2"))) static inline __m256 CompactSd(__m256i c, uint16_t max_mm) {
+    c = _mm256_and_si256(c, _mm256_set1_epi32(max_mm));
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(c), _mm256_set1_ps(0.001f));
+}
+
+// Process groups of 8 points starting at k.
+// Gathers read 4 bytes so groups that touch the last cells of the halo are left to the caller.
+// -> index of the first point not processed
+__attribute__((target("avx2"))) static int GetManyAvx2(int k, int n, const float *lon, const float *lat, float *sd,
+                                                         bool *is_extended, float resolution, int width, int height,
+                                                         const float *val, const bool *extended_snow,
+                                                         const uint16_t *cval, uint16_t compact_max_mm,
+                                                         uint16_t compact_extended) {
+    const __m256 v_res = _mm256_set1_ps(resolution);
+    const __m256i v_width = _mm256_set1_epi32(width);
+    const __m256i v_height = _mm256_set1_epi32(height);
+    const __m256i v_one = _mm256_set1_epi32(1);
+    const __m256i v_stride = _mm256_set1_epi32(width + 2);
+    const __m256i v_limit = _mm256_set1_epi32((width + 2) * (height + 2) - 4);
+    const __m256 f_one = _mm256_set1_ps(1.0f);
+
+    for (; k + 8 <= n; k += 8) {
+        __m256 x = _mm256_loadu_ps(lon + k);
+        __m256 y = _mm256_add_ps(_mm256_loadu_ps(lat + k), _mm256_set1_ps(90.0f));
+
+        __m256 neg = _mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_LT_OQ);
+        x = _mm256_blendv_ps(x, _mm256_add_ps(x, _mm256_set1_ps(360.0f)), neg);
+
+        x = _mm256_div_ps(x, v_res);
+        y = _mm256_div_ps(y, v_res);
+
+        __m256i i_lon = _mm256_cvttps_epi32(x);
+        __m256i i_lat = _mm256_cvttps_epi32(y);
+        __m256 s = _mm256_sub_ps(x, _mm256_cvtepi32_ps(i_lon));
+        __m256 t = _mm256_sub_ps(y, _mm256_cvtepi32_ps(i_lat));
+
+        // = Idx(), the right and upper neighbors are in the halo
+        __m256i lon0 = _mm256_add_epi32(WrapLon(i_lon, v_width), v_one);
+        __m256i row0 = _mm256_mullo_epi32(_mm256_add_epi32(ClampLat(i_lat, v_height), v_one), v_stride);
+        __m256i i00 = _mm256_add_epi32(row0, lon0);
+        __m256i i10 = _mm256_add_epi32(i00, v_one);
+        __m256i i01 = _mm256_add_epi32(i00, v_stride);
+        __m256i i11 = _mm256_add_epi32(i01, v_one);
+
+        // i11 is the largest index
+        __m256i beyond = _mm256_cmpgt_epi32(i11, v_limit);
+        if (!_mm256_testz_si256(beyond, beyond))
+            return k;
+
+        __m256 v00, v10, v01, v11;
+        __m256i es;
+        if (cval) {
+            const __m256i mask = _mm256_set1_epi32(0xffff);
+            __m256i c00 = _mm256_and_si256(_mm256_i32gather_epi32((const int *)cval, i00, 2), mask);
+            __m256i c10 = _mm256_and_si256(_mm256_i32gather_epi32((const int *)cval, i10, 2), mask);
+            __m256i c01 = _mm256_and_si256(_mm256_i32gather_epi32((const int *)cval, i01, 2), mask);
+            __m256i c11 = _mm256_and_si256(_mm256_i32gather_epi32((const int *)cval, i11, 2), mask);
+            v00 = CompactSd(c00, compact_max_mm);
+            v10 = CompactSd(c10, compact_max_mm);
+            v01 = CompactSd(c01, compact_max_mm);
+            v11 = CompactSd(c11, compact_max_mm);
+            es = _mm256_and_si256(_mm256_or_si256(_mm256_or_si256(c00, c10), _mm256_or_si256(c01, c11)),
+                                  _mm256_set1_epi32(compact_extended));
+        } else {
+            v00 = _mm256_i32gather_ps(val, i00, 4);
+            v10 = _mm256_i32gather_ps(val, i10, 4);
+            v01 = _mm256_i32gather_ps(val, i01, 4);
+            v11 = _mm256_i32gather_ps(val, i11, 4);
+            const int *es_base = (const int *)extended_snow;
+            es = _mm256_or_si256(_mm256_or_si256(_mm256_i32gather_epi32(es_base, i00, 1),
+                                                 _mm256_i32gather_epi32(es_base, i10, 1)),
+                                 _mm256_or_si256(_mm256_i32gather_epi32(es_base, i01, 1),
+                                                 _mm256_i32gather_epi32(es_base, i11, 1)));
+            es = _mm256_and_si256(es, _mm256_set1_epi32(0xff));
+        }
+
+        // same order of operations as Get()
+        __m256 p00 = _mm256_mul_ps(_mm256_sub_ps(f_one, s), _mm256_sub_ps(f_one, t));
+        __m256 p10 = _mm256_mul_ps(s, _mm256_sub_ps(f_one, t));
+        __m256 p01 = _mm256_mul_ps(_mm256_sub_ps(f_one, s), t);
+        __m256 p11 = _mm256_mul_ps(s, t);
+
+        __m256 v = _mm256_add_ps(_mm256_mul_ps(v00, p00), _mm256_mul_ps(v10, p10));
+        v = _mm256_add_ps(v, _mm256_mul_ps(v01, p01));
+        v = _mm256_add_ps(v, _mm256_mul_ps(v11, p11));
+        _mm256_storeu_ps(sd + k, v);
+
+        int es_bits = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(es, _mm256_setzero_si256())));
+        for (int l = 0; l < 8; l++)
+            is_extended[k + l] = !(es_bits & (1 << l));
+    }
+
+    return k;
+}
+#endif
+
+void DepthMap::GetMany(int n, const float* lon, const float* lat, float* sd, bool* is_extended) const {
+    int k = 0;
+#ifdef DEPTH_MAP_AVX2
+    static const bool have_avx2 = __builtin_cpu_supports("avx2");
+    if (have_avx2) {
+        while (k < n) {
+            k = GetManyAvx2(k, n, lon, lat, sd, is_extended, resolution_, width_, height_, val_, extended_snow_,
+                            cval_, kCompactMaxMm, kCompactExtended);
+
+            // the group that was left over
+            for (int end = std::min(k + 8, n); k < end; k++)
+                std::tie(sd[k], is_extended[k]) = Get(lon[k], lat[k]);
+        }
+    }
+#endif
+
+    for (; k < n; k++)
+        std::tie(sd[k], is_extended[k]) = Get(lon[k], lat[k]);
+}
+
+void DepthMap::Compact() {
+    if (cval_)
+        return;
+
+    int n = n_cells_;
+    cval_buf_ = std::make_unique<uint16_t[]>(n);
+    cval_ = cval_buf_.get();
+
+    int n_clamped = 0;
+    for (int i = 0; i < n; i++) {
+        long mm = std::lroundf(val_[i] * 1000.0f);
+        if (mm > kCompactMaxMm) {
+            mm = kCompactMaxMm;
+            n_clamped++;
+        } else if (mm < 0)
+            mm = 0;
+
+        cval_[i] = mm | (extended_snow_[i] ? kCompactExtended : 0);
+    }
+
+    val_ = nullptr;
+    extended_snow_ = nullptr;
+    val_buf_ = nullptr;
+    extended_snow_buf_ = nullptr;
+    snapshot_ = nullptr;
+    LogMsg("DepthMap %d compacted, %d grid points clamped", seqno_, n_clamped);
+}
+
+// "lon, lat, value," with arbitrary blanks and an optional trailing ','
+DepthMap::CSVLine DepthMap::LoadCSVLine(const char* line, const char* end) {
+    float v[3];
+    std::string_view rest(line, end - line);
+    for (int i = 0; i < 3; i++) {
+        size_t comma = rest.find(',');
+        if (i < 2 && comma == std::string_view::npos)
+            return CSVLine::kInvalid;
+
+        std::string_view w = rest.substr(0, comma);
+        rest = (comma == std::string_view::npos) ? std::string_view() : rest.substr(comma + 1);
+
+        size_t first = w.find_first_not_of(" \r");
+        if (first == std::string_view::npos)
+            return CSVLine::kInvalid;
+        w = w.substr(first, w.find_last_not_of(" \r") + 1 - first);
+
+        if (!ToFloat(w, v[i]))
+            return CSVLine::kInvalid;
+    }
+
+    float lon = v[0], lat = v[1], value = v[2];
+    if (value < 0.001f)
+        return CSVLine::kSkipped;
+
+    // Convert longitude and latitude to array indices (with rounding!)
+    int x = std::lroundf(lon / resolution_);
+    int y = std::lroundf((lat + 90.0f) / resolution_);  // Adjust for negative latitudes
+
+    if (x < 0 || x >= width_ || y < 0 || y >= height_)
+        return CSVLine::kInvalid;
+
+    val_[Idx(x, y)] = value;
+    return CSVLine::kLoaded;
+}
+
 void DepthMap::LoadCSV(const char* csv_name) {
-    std::ifstream file(csv_name);
-    if (!file.is_open()) {
+    MappedFile file;
+    if (!file.Open(csv_name)) {
         LogMsg("Error opening file: %s", csv_name);
         return;
     }
 
-    std::string line;
-    int counter = 0;
+    const char* data = (const char*)file.data();
+    const char* end = data + file.size();
 
     // Skip the header
-    std::getline(file, line);
-    counter++;
+    const char* p = (const char*)memchr(data, '\n', end - data);
+    p = (p == nullptr) ? end : p + 1;
+
+    // Split into line aligned chunks that are processed in parallel.
+    // Chunks write to disjoint grid points unless the csv contains a grid point twice,
+    // which then has the same value anyway.
+    static constexpr size_t kMinChunkSize = 1024 * 1024;
+    int n_chunks = std::clamp((int)std::thread::hardware_concurrency(), 1, 8);
+    n_chunks = std::clamp((int)((end - p) / kMinChunkSize), 1, n_chunks);
+
+    struct Chunk {
+        const char *begin, *end;
+        int counter{0};
+        std::vector<std::string> invalid_lines;     // LogMsg is not necessarily thread safe
+    };
+
+    std::vector<Chunk> chunks(n_chunks);
+    size_t chunk_size = (end - p) / n_chunks;
+    for (int i = 0; i < n_chunks; i++) {
+        chunks[i].begin = p;
+        if (i == n_chunks - 1)
+            p = end;
+        else {
+            p = (const char*)memchr(p + chunk_size, '\n', end - (p + chunk_size));
+            p = (p == nullptr) ? end : p + 1;
+        }
+        chunks[i].end = p;
+    }
+
+    auto worker = [this](Chunk& chunk) {
+        const char* p = chunk.begin;
+        while (p < chunk.end) {
+            const char* nl = (const char*)memchr(p, '\n', chunk.end - p);
+            const char* eol = (nl == nullptr) ? chunk.end : nl;
+            const char* line_end = (eol > p && eol[-1] == '\r') ? eol - 1 : eol;
+
+            if (line_end > p) {
+                CSVLine res = LoadCSVLine(p, line_end);
+                if (res == CSVLine::kLoaded)
+                    chunk.counter++;
+                else if (res == CSVLine::kInvalid)
+                    chunk.invalid_lines.emplace_back(p, line_end);
+            }
 
-    while (std::getline(file, line)) {
-        float lat, lon, value;
-        if (3 != sscanf(line.c_str(), "%f,%f,%f", &lon, &lat, &value)) {
+            p = eol + 1;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < n_chunks; i++)
+        threads.emplace_back(worker, std::ref(chunks[i]));
+
+    worker(chunks[0]);
+    for (auto& t : threads)
+        t.join();
+
+    int counter = 1;    // header
+    for (auto& chunk : chunks) {
+        for (auto& line : chunk.invalid_lines)
             LogMsg("invalid csv line: '%s'", line.c_str());
-            continue;
+        counter += chunk.counter;
+    }
+
+    LogMsg("Loaded %d lines from CSV file '%s' using %d threads", counter, csv_name, n_chunks);
+    FinishLoad();
+}
+
+void DepthMap::CSVStream::Feed(const char* data, size_t len) {
+    const char* end = data + len;
+    while (data < end) {
+        const char* nl = (const char*)memchr(data, '\n', end - data);
+        if (nl == nullptr) {
+            line_.append(data, end - data);
+            return;
         }
 
+        if (line_.empty()) {
+            Line(data, nl);
+        } else {
+            // completes a line from a previous chunk
+            line_.append(data, nl - data);
+            Line(line_.data(), line_.data() + line_.size());
+            line_.clear();
+        }
+
+        data = nl + 1;
+    }
+}
+
+void DepthMap::CSVStream::Line(const char* line, const char* end) {
+    if (end > line && end[-1] == '\r')
+        end--;
+
+    // skip the header
+    if (n_lines_++ > 0 && end > line) {
+        CSVLine res = map_.LoadCSVLine(line, end);
+        if (res == CSVLine::kLoaded)
+            counter_++;
+        else if (res == CSVLine::kInvalid)
+            LogMsg("invalid csv line: '%.*s'", (int)(end - line), line);
+    }
+}
+
+int DepthMap::CSVStream::Finish() {
+    if (!line_.empty()) {
+        Line(line_.data(), line_.data() + line_.size());
+        line_.clear();
+    }
+
+    LogMsg("Loaded %d lines from CSV stream", counter_);
+    if (counter_ > 0)
+        map_.FinishLoad();
+    return counter_;
+}
+
+bool DepthMap::LoadGrib(const uint8_t* data, size_t len) {
+    GribField field;
+    if (!GribDecode(data, len, kGribSNOD, field))
+        return false;
+
+    int n_points = field.ni * field.nj;
+    int counter = 0;
+    for (int k = 0; k < n_points; k++) {
+        if (!field.defined[k])
+            continue;
+
+        float value = field.val[k];
         if (value < 0.001f)
             continue;
 
-        // Convert longitude and latitude to array indices (with rounding!)
+        float lon, lat;
+        field.LonLat(k, lon, lat);
+        if (lon < 0.0f)
+            lon += 360.0f;
+
+        // same mapping as for the csv
         int x = std::lroundf(lon / resolution_);
-        int y = std::lroundf((lat + 90.0f) / resolution_);  // Adjust for negative latitudes
+        int y = std::lroundf((lat + 90.0f) / resolution_);
+        if (x == width_)
+            x = 0;
 
         if (x < 0 || x >= width_ || y < 0 || y >= height_) {
-            LogMsg("invalid csv line: '%s'", line.c_str());
-            continue;
+            LogMsg("invalid grid point: (%0.3f, %0.3f)", lon, lat);
+            return false;
         }
 
-        val_[y * width_ + x] = value;
+        val_[Idx(x, y)] = value;
         counter++;
     }
 
-    LogMsg("Loaded %d lines from CSV file '%s'", counter, csv_name);
+    LogMsg("Loaded %d grid points from GRIB", counter);
+    FinishLoad();
+    return true;
+}
+
+bool DepthMap::LoadGrib(const std::string& grib_name) {
+    std::ifstream file(grib_name, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        LogMsg("Error opening file: %s", grib_name.c_str());
+        return false;
+    }
+
+    size_t len = file.tellg();
+    std::vector<uint8_t> data(len);
+    file.seekg(0);
+    file.read((char*)data.data(), len);
+    if (file.fail()) {
+        LogMsg("Error reading file: %s", grib_name.c_str());
+        return false;
+    }
+
+    return LoadGrib(data.data(), len);
+}
+
+void DepthMap::FinishLoad() {
+    if (!coast_map.is_loaded()) {
+        LogMsg("No coast map, coastal snow is not extended");
+    } else {
+        // Use multiple passes for snow extension, e.g. for fjords, islands close to coast, ...
+        // A pass reads the result of the previous pass and the grid is split into latitude bands
+        // that are processed in parallel.
+        // A band writes at most 1 row beyond its limits and writes are max() operations.
+        // So bands that are not adjacent can run concurrently and the result is deterministic.
+        // That needs bands of at least 2 rows, hence an even # of bands <= height_ / 2.
+        int n_threads = extend_threads_ > 0 ? extend_threads_
+                                            : std::clamp((int)std::thread::hardware_concurrency(), 1, 8);
+        int n_bands = std::max(2, std::min(2 * n_threads, height_ / 2) & ~1);
+        n_threads = n_bands / 2;
+        auto prev_val = std::make_unique<float[]>(n_cells_);
+
+        for (int pass = 0; pass < 3; pass++) {
+            memcpy(prev_val.get(), val_, n_cells_ * sizeof(float));
+
+            std::vector<int> n_extend(n_bands);
+            auto band = [&](int b) {
+                n_extend[b] = ExtendCoastalSnow(prev_val.get(), b * height_ / n_bands, (b + 1) * height_ / n_bands);
+            };
+
+            // even bands, then odd bands
+            for (int phase = 0; phase < 2; phase++) {
+                std::vector<std::thread> threads;
+                for (int b = phase + 2; b < n_bands; b += 2)
+                    threads.emplace_back(band, b);
+
+                band(phase);
+                for (auto& t : threads)
+                    t.join();
+            }
+
+            int n = 0;
+            for (int ne : n_extend)
+                n += ne;
+            LogMsg("Extended coastal snow on %d grid points using %d threads", n, n_threads);
+        }
+    }
+
+    FillHalo();
+}
+
+void DepthMap::FillHalo() {
+    // wrap around columns
+    for (int y = 0; y < height_; y++) {
+        val_[Idx(-1, y)] = val_[Idx(width_ - 1, y)];
+        val_[Idx(width_, y)] = val_[Idx(0, y)];
+        extended_snow_[Idx(-1, y)] = extended_snow_[Idx(width_ - 1, y)];
+        extended_snow_[Idx(width_, y)] = extended_snow_[Idx(0, y)];
+    }
 
-    // use multiple passes for snow extension, e.g. for fjords, islands close to coast, ...
-    ExtendCoastalSnow();
-    ExtendCoastalSnow();
-    ExtendCoastalSnow();
+    // duplicated pole rows including their halo columns
+    memcpy(&val_[Idx(-1, -1)], &val_[Idx(-1, 0)], stride_ * sizeof(float));
+    memcpy(&val_[Idx(-1, height_)], &val_[Idx(-1, height_ - 1)], stride_ * sizeof(float));
+    memcpy(&extended_snow_[Idx(-1, -1)], &extended_snow_[Idx(-1, 0)], stride_ * sizeof(bool));
+    memcpy(&extended_snow_[Idx(-1, height_)], &extended_snow_[Idx(-1, height_ - 1)], stride_ * sizeof(bool));
 }
 
-void DepthMap::ExtendCoastalSnow() {
+// extend coastal snow for the coast grid points with j in [j_begin, j_end)
+// snow depth is read from prev_val and written to val_
+int DepthMap::ExtendCoastalSnow(const float *prev_val, int j_begin, int j_end) {
     static constexpr float min_sd = 0.02f;  // only go higher than this snow depth
     int n_extend = 0;
 
-    for (int i = 0; i < width_; i++) {
-        for (int j = 0; j < height_; j++) {
-            float sd = val_[MapIdx(i, j)];
-            static constexpr int max_step = 2;  // to look for inland snow ~ 10 to 20 km / step
-            float lon = i * resolution_;
-            float lat = j * resolution_ - 90.0f;
-            auto [is_coast, dir_x, dir_y, dir_angle] = coast_map.is_coast(lon, lat);
-            if (is_coast && sd <= min_sd) {
-                // look for inland snow
-                int inland_dist = 0;
-                float inland_sd = 0.0f;
-                for (int k = 1; k <= max_step; k++) {
-                    int ii = i + k * dir_x;
-                    int jj = j + k * dir_y;
-                    float lon = ii * resolution_;
-                    float lat = jj * resolution_ - 90.0f;
-
-                    if (k < max_step && coast_map.is_water(lon, lat)) {  // if possible skip water
-                        continue;
-                    }
-
-                    float tmp = val_[MapIdx(ii, jj)];
-                    if (tmp > sd && tmp > min_sd) {  // found snow
-                        inland_dist = k;
-                        inland_sd = tmp;
-                        break;
-                    }
-                }
+    assert(resolution_ == kSnodResolution);
+    const auto& cells = coast_map.coast_cells();
+    auto by_j = [](const CoastMap::CoastCell& c, int j) { return c.j < j; };
+    auto begin = std::lower_bound(cells.begin(), cells.end(), j_begin, by_j);
+    auto end = std::lower_bound(begin, cells.end(), j_end, by_j);
+
+    for (auto cell = begin; cell < end; cell++) {
+        int i = cell->i, j = cell->j;
+        int dir_x = cell->dir_x, dir_y = cell->dir_y;
+        float sd = prev_val[MapIdx(i, j)];
+        static constexpr int max_step = 2;  // to look for inland snow ~ 10 to 20 km / step
+        if (sd > min_sd)
+            continue;
 
-                static constexpr float decay = 0.8f;  // snow depth decay per step
-                if (inland_dist > 0) {
-                    // LogMsg("Inland snow detected for (%d, %d) at dist %d, sd: %0.3f %0.3f",
-                    //		  i, j, inland_dist, sd, inland_sd)
-
-                    // use exponential decay law from inland point to coast line point
-                    for (int k = inland_dist - 1; k >= 0; k--) {
-                        inland_sd *= decay;
-                        if (inland_sd < min_sd) {
-                            inland_sd = min_sd;
-                        }
-                        int x = i + k * dir_x;
-                        int y = j + k * dir_y;
-                        if (x >= width_)
-                            x -= width_;
-                        else if (x < 0)
-                            x += width_;
-
-                        // the poles are tricky so we just clamp
-                        // anyway it does not make a difference
-                        if (y >= height_)
-                            y = height_ - 1;
-                        else if (y < 0)
-                            y = 0;
-
-                        val_[y * width_ + x] = std::max(val_[y * width_ + x], inland_sd);
-                        extended_snow_[y * width_ + x] = true;
-                        n_extend++;
-                    }
+        // look for inland snow
+        int inland_dist = 0;
+        float inland_sd = 0.0f;
+        for (int k = 1; k <= max_step; k++) {
+            int ii = i + k * dir_x;
+            int jj = j + k * dir_y;
+
+            // the index has the water flag of the first step only
+            static_assert(max_step == 2);
+            if (k < max_step && cell->water_1) {  // if possible skip water
+                continue;
+            }
+
+            float tmp = prev_val[MapIdx(ii, jj)];
+            if (tmp > sd && tmp > min_sd) {  // found snow
+                inland_dist = k;
+                inland_sd = tmp;
+                break;
+            }
+        }
+
+        static constexpr float decay = 0.8f;  // snow depth decay per step
+        if (inland_dist > 0) {
+            // LogMsg("Inland snow detected for (%d, %d) at dist %d, sd: %0.3f %0.3f",
+            //		  i, j, inland_dist, sd, inland_sd)
+
+            // use exponential decay law from inland point to coast line point
+            for (int k = inland_dist - 1; k >= 0; k--) {
+                inland_sd *= decay;
+                if (inland_sd < min_sd) {
+                    inland_sd = min_sd;
                 }
+                int x = i + k * dir_x;
+                int y = j + k * dir_y;
+                if (x >= width_)
+                    x -= width_;
+                else if (x < 0)
+                    x += width_;
+
+                // the poles are tricky so we just clamp
+                // anyway it does not make a difference
+                if (y >= height_)
+                    y = height_ - 1;
+                else if (y < 0)
+                    y = 0;
+
+                val_[Idx(x, y)] = std::max(val_[Idx(x, y)], inland_sd);
+                extended_snow_[Idx(x, y)] = true;
+                n_extend++;
             }
         }
     }
 
-    LogMsg("Extended coastal snow on %d grid points", n_extend);
+    return n_extend;
+}
+
+//------------------------------------------------------------------------------------
+// Snapshot = final state of a map in a binary file:
+// header, val_[n_cells_], extended_snow_[n_cells_]
+// or for compact maps
+// header, cval_[n_cells_]
+// The arrays include the halo.
+// The payload is protected by a crc32.
+//
+static constexpr char kSnapshotMagic[8] = "XASNOD";
+static constexpr uint32_t kSnapshotVersion = 4;   // bump whenever the map content changes
+
+static constexpr uint32_t kSnapshotFloat = 0;
+static constexpr uint32_t kSnapshotCompact = 1;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t format;            // kSnapshotFloat or kSnapshotCompact
+    float resolution;
+    int32_t width, height;
+    int32_t seqno;              // seqno of the map that was saved, informational only
+    uint32_t crc;               // of the payload
+    uint64_t payload_size;
+    char source[64];
+};
+
+static_assert(sizeof(bool) == 1);
+static_assert(sizeof(SnapshotHeader) % sizeof(float) == 0);
+
+// -> size of the payload
+static size_t SnapshotPayloadSize(uint32_t format, size_t n) {
+    return (format == kSnapshotCompact) ? n * sizeof(uint16_t) : n * (sizeof(float) + sizeof(bool));
+}
+
+bool DepthMap::SaveSnapshot(const std::string& fn, const std::string& source) const {
+    SnapshotHeader hdr{};
+    memcpy(hdr.magic, kSnapshotMagic, sizeof(hdr.magic));
+    hdr.version = kSnapshotVersion;
+    hdr.header_size = sizeof(hdr);
+    hdr.format = cval_ ? kSnapshotCompact : kSnapshotFloat;
+    hdr.resolution = resolution_;
+    hdr.width = width_;
+    hdr.height = height_;
+    hdr.seqno = seqno_;
+    snprintf(hdr.source, sizeof(hdr.source), "%s", source.c_str());
+
+    // the payload in pieces
+    size_t n = n_cells_;
+    std::vector<std::pair<const void*, size_t>> payload;
+    if (cval_)
+        payload.push_back({cval_, n * sizeof(uint16_t)});
+    else {
+        payload.push_back({val_, n * sizeof(float)});
+        payload.push_back({extended_snow_, n * sizeof(bool)});
+    }
+
+    hdr.payload_size = SnapshotPayloadSize(hdr.format, n);
+    uLong crc = crc32(0L, Z_NULL, 0);
+    for (auto [p, len] : payload)
+        crc = crc32(crc, (const Bytef*)p, len);
+    hdr.crc = crc;
+
+    // write to a temp file first so readers never see a partial file
+    std::string tmp_fn = fn + ".tmp";
+    std::ofstream f(tmp_fn, std::ios::binary);
+    if (!f.is_open()) {
+        LogMsg("Can't create snapshot '%s'", tmp_fn.c_str());
+        return false;
+    }
+
+    f.write((const char*)&hdr, sizeof(hdr));
+    for (auto [p, len] : payload)
+        f.write((const char*)p, len);
+    f.close();
+
+    std::error_code ec;
+    if (!f.fail())
+        std::filesystem::rename(tmp_fn, fn, ec);
+
+    if (f.fail() || ec) {
+        LogMsg("Can't write snapshot '%s'", fn.c_str());
+        std::filesystem::remove(tmp_fn, ec);
+        return false;
+    }
+
+    LogMsg("Snapshot of DepthMap %d saved to '%s'", seqno_, fn.c_str());
+    return true;
+}
+
+std::unique_ptr<DepthMap> DepthMap::LoadSnapshot(const std::string& fn, const std::string& source) {
+    auto snapshot = std::make_unique<MappedFile>();
+    if (!snapshot->Open(fn))
+        return nullptr;
+
+    const uint8_t *data = snapshot->data();
+    size_t size = snapshot->size();
+
+    SnapshotHeader hdr;
+    if (size < sizeof(hdr)) {
+        LogMsg("Snapshot '%s' is truncated", fn.c_str());
+        return nullptr;
+    }
+
+    memcpy(&hdr, data, sizeof(hdr));
+    size_t n = ((size_t)hdr.width + 2) * ((size_t)hdr.height + 2);   // with halo
+    if (memcmp(hdr.magic, kSnapshotMagic, sizeof(hdr.magic)) != 0 || hdr.version != kSnapshotVersion
+        || hdr.header_size != sizeof(hdr) || (hdr.format != kSnapshotFloat && hdr.format != kSnapshotCompact)
+        || hdr.payload_size != SnapshotPayloadSize(hdr.format, n)
+        || size != sizeof(hdr) + hdr.payload_size) {
+        LogMsg("Snapshot '%s' has an invalid header or version", fn.c_str());
+        return nullptr;
+    }
+
+    hdr.source[sizeof(hdr.source) - 1] = '\0';
+    if (source != hdr.source) {
+        LogMsg("Snapshot '%s' is from '%s', expected '%s'", fn.c_str(), hdr.source, source.c_str());
+        return nullptr;
+    }
+
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, data + sizeof(hdr), hdr.payload_size);
+    if (crc != hdr.crc) {
+        LogMsg("Snapshot '%s' has an invalid checksum", fn.c_str());
+        return nullptr;
+    }
+
+    // private constructor
+    auto map = std::unique_ptr<DepthMap>(new DepthMap());
+
+    // a new seqno as this is a new map for the consumers
+    map->seqno_ = ++seqno_base_;
+    map->resolution_ = hdr.resolution;
+    map->SetSize(hdr.width, hdr.height);
+    if (hdr.format == kSnapshotCompact)
+        map->cval_ = (uint16_t*)(data + sizeof(hdr));
+    else {
+        map->val_ = (float*)(data + sizeof(hdr));
+        map->extended_snow_ = (bool*)(data + sizeof(hdr) + n * sizeof(float));
+    }
+    map->snapshot_ = std::move(snapshot);
+    LogMsg("DepthMap %d loaded from snapshot '%s' (saved as %d)", map->seqno_, fn.c_str(), hdr.seqno);
+    return map;
 }
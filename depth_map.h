@@ -23,24 +23,85 @@
 #ifndef _DEPTH_MAP_H_
 #define _DEPTH_MAP_H_
 
+#include "mapped_file.h"
+
 class DepthMap {
     static int seqno_base_;
 
-    int seqno_;
+    int seqno_{0};
     float resolution_;
     int width_, height_;
 
-    std::unique_ptr<float[]> val_;
-    std::unique_ptr<bool[]> extended_snow_;
+    // The grid is surrounded by a halo of 1 grid point:
+    // a wrapped column on each side and a duplicated row at each pole.
+    // So the neighbors of any grid point are simple offsets.
+    int stride_;                // = width_ + 2
+    int n_cells_;               // = stride_ * (height_ + 2)
+
+    // Storage is either owned or mapped read-only from a snapshot file.
+    // A map loaded from a snapshot is never modified.
+    std::unique_ptr<float[]> val_buf_;
+    std::unique_ptr<bool[]> extended_snow_buf_;
+    std::unique_ptr<uint16_t[]> cval_buf_;
+    std::unique_ptr<MappedFile> snapshot_;
+
+    // either float + bool or compact storage is used
+    float *val_{nullptr};
+    bool *extended_snow_{nullptr};
 
-    void ExtendCoastalSnow();
-    int MapIdx(int i_lon, int i_lat) const;    // idx into array
+    // compact storage: snow depth in mm in bits 0..14, extended snow in bit 15
+    static constexpr uint16_t kCompactExtended = 0x8000;
+    static constexpr uint16_t kCompactMaxMm = 0x7fff;
+    uint16_t *cval_{nullptr};
+
+    DepthMap() = default;
+    void SetSize(int width, int height);
+    int ExtendCoastalSnow(const float *prev_val, int j_begin, int j_end);   // -> # of extended grid points
+    void FillHalo();
+    void FinishLoad();
+    enum class CSVLine { kLoaded, kSkipped, kInvalid };
+    CSVLine LoadCSVLine(const char *line, const char *end);     // line without '\n'
+    int MapIdx(int i_lon, int i_lat) const;    // idx into array with wrap around and clamping
+    int Idx(int x, int y) const { return (y + 1) * stride_ + x + 1; }   // x in [-1, width_], y in [-1, height_]
 
  public:
     DepthMap(float resolution);     // in fractions of 1° e.g. 0.25
     ~DepthMap() { LogMsg("DepthMap destroyed: %d", seqno_); }
     std::tuple<float, bool> Get(float lon, float lat) const;    // return snow depth and "some neighbor" has extended snow
+    // Get() for n points, uses AVX2 if available, results are identical to Get()
+    void GetMany(int n, const float *lon, const float *lat, float *sd, bool *is_extended) const;
     void LoadCSV(const char *csv_name);
+
+    // load csv data that arrives in arbitrary chunks, e.g. from a pipe
+    class CSVStream {
+        DepthMap& map_;
+        std::string line_;          // a line that spans chunks, complete lines are parsed in place
+        int n_lines_{0};
+        int counter_{0};
+
+        void Line(const char *line, const char *end);
+
+      public:
+        CSVStream(DepthMap& map) : map_(map) {}
+        void Feed(const char *data, size_t len);
+        int Finish();               // -> # of loaded lines
+    };
+    bool LoadGrib(const uint8_t *data, size_t len);  // -> success
+    bool LoadGrib(const std::string& grib_name);
     int SeqNo() const { return seqno_; }
+
+    // # of threads for the coastal snow extension, 0 = hardware concurrency
+    // the result does not depend on it
+    static int extend_threads_;
+
+    // Convert a loaded map to compact storage, 2 instead of 5 bytes per grid point.
+    // Snow depth is rounded to mm. The map can't be loaded into afterwards.
+    void Compact();
+    bool IsCompact() const { return cval_ != nullptr; }
+
+    // source identifies the input data, e.g. name of the grib file
+    bool SaveSnapshot(const std::string& fn, const std::string& source) const;   // -> success
+    // -> nullptr if fn does not exist, is invalid or was created from a different source
+    static std::unique_ptr<DepthMap> LoadSnapshot(const std::string& fn, const std::string& source);
 };
 #endif
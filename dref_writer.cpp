@@ -0,0 +1,53 @@
+//
+//    X Airline Snow: show accumulated snow in X-Plane's world
+//
+//    Copyright (C) 2025  Holger Teutsch
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+#include <cmath>
+
+#include "dref_writer.h"
+
+uint64_t DrefWriter::n_written_, DrefWriter::n_suppressed_;
+
+void DrefWriter::Write(float value, double now) {
+    set_(dref_, value);
+    n_written_++;
+    valid_ = true;
+    last_value_ = value;
+    last_time_ = now;
+}
+
+void DrefWriter::Set(float value, double now) {
+    double dt = now - last_time_;
+    if (!valid_ || dt >= refresh_interval_ || (dt >= min_interval_ && fabsf(value - last_value_) > eps_)) {
+        Write(value, now);
+        return;
+    }
+
+    n_suppressed_++;
+}
+
+void DrefWriter::Set(float value, float current, double now) {
+    if (fabsf(value - current) > eps_) {
+        Write(value, now);
+        return;
+    }
+
+    n_suppressed_++;
+}
@@ -0,0 +1,68 @@
+//
+//    X Airline Snow: show accumulated snow in X-Plane's world
+//
+//    Copyright (C) 2025  Holger Teutsch
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+#ifndef _DREF_WRITER_H_
+#define _DREF_WRITER_H_
+
+#include <cstdint>
+
+#include "XPLMDataAccess.h"
+
+// Writes a float dataref only when it changed by more than eps_, at most every min_interval_
+// seconds. As X-Plane may change the dataref on its own the last value is rewritten
+// every refresh_interval_ seconds even if unchanged.
+// The setter is XPLMSetDataf in the plugin and a mock in the bench.
+class DrefWriter {
+  public:
+    using Setter = void (*)(XPLMDataRef, float);
+
+  private:
+    XPLMDataRef dref_{nullptr};
+    Setter set_;
+    float eps_;
+    double min_interval_, refresh_interval_;    // s
+
+    bool valid_{false};         // last_value_ is what the dataref holds
+    float last_value_{0.0f};
+    double last_time_{0.0};
+
+  public:
+    // totals over all writers
+    static uint64_t n_written_, n_suppressed_;
+
+    DrefWriter(Setter set, float eps, double min_interval, double refresh_interval)
+        : set_(set), eps_(eps), min_interval_(min_interval), refresh_interval_(refresh_interval) {}
+
+    void set_dref(XPLMDataRef dref) {
+        dref_ = dref;
+        valid_ = false;
+    }
+
+    // now = a time in s, e.g. from a steady clock
+    void Set(float value, double now);
+
+    // for datarefs we read anyway, current is the value in the sim, with eps_ = 0 any difference is written
+    void Set(float value, float current, double now);
+
+    // write unconditionally, e.g. for a reset
+    void Write(float value, double now);
+};
+#endif
@@ -21,13 +21,17 @@
 //
 
 #include <cstdio>
+#include <cstring>
 #include <ctime>
 #include <array>
+#include <algorithm>
 #include <string>
 #include <mutex>
 #include <future>
 #include <chrono>
 #include <fstream>
+#include <sstream>
+#include <vector>
 #include <filesystem>
 #include <stdexcept>
 
@@ -37,9 +41,41 @@
 // A note on async processing:
 // Everything is synchronously fired by the flightloop so we don't need mutexes
 
-// these 2 variables are owned and written by the main (= flightloop) thread
+// A GFS product is identified by its cycle and the forecast hour
+struct GribStep {
+    std::time_t cycle{0};       // start of the cycle (UTC)
+    int forecast{0};            // h
+
+    std::time_t Valid() const { return cycle + forecast * 3600; }
+    bool operator==(const GribStep&) const = default;
+};
+
+// these variables are owned and written by the main (= flightloop) thread
 static bool download_active;
 std::unique_ptr<DepthMap> snod_map;
+static GribStep snod_step;                          // step of snod_map
+static std::unique_ptr<DepthMap> next_snod_map;     // map of the following step
+static GribStep next_step;
+static bool next_sys_time;                          // mode of next_snod_map
+static std::time_t snow_time;                       // time we get snow for
+static bool snow_sys_time;                          // mode we get snow for, system time or historical
+
+// what to do with the map when the download is done
+enum class DownloadMode {
+    kLoad,          // make it snod_map whatever we get (explicit request)
+    kCurrent,       // make it snod_map on success, otherwise keep the current map
+    kNext           // make it next_snod_map on success
+};
+
+static DownloadMode download_mode;
+static GribStep download_step;
+static bool download_sys_time;
+static std::time_t retry_after;                     // no scheduled downloads before that (system time)
+
+// an explicit request that came in while a download was active, started when that one is done
+static bool load_pending;
+static bool load_pending_sys_time;
+static GribStep load_pending_step;
 
 // use of this variable is alternate
 // If download_active:
@@ -50,62 +86,72 @@ std::unique_ptr<DepthMap> new_snod_map;
 // variable under system control
 static std::future<bool> download_future;
 
-// in:  user specified time
-// out: url, cycle time, cycle num
-static std::tuple<std::string, std::tm, int>
-GetDownloadUrl(bool sys_time, const std::tm utime_utc)
+// GFS cycles start every 6 hours and are published with a delay of ~ 4:25
+static constexpr int kCycleLength = 6 * 3600;                   // s
+static constexpr int kPublishDelay = 4 * 3600 + 25 * 60;        // s
+static constexpr int kForecastStep = 3;                         // h, forecast hours we use
+static constexpr int kHistoricalForecast = 6;                   // h, the only one in the archive
+// delay after a failed scheduled download
+static constexpr int kRetryDelay = 10 * 60;                     // s
+
+// the png shows the map in use, the one of a prefetched map is renamed when it's promoted
+static constexpr char kPngName[] = "snow_depth.png";
+static constexpr char kNextPngName[] = "snow_depth_next.png";
+
+// -> the 2 steps whose valid times enclose t
+static std::pair<GribStep, GribStep>
+GribSteps(bool sys_time, std::time_t t)
 {
-    // Adjusted time considering publish delay
-    std::tm ctime_utc = utime_utc;
-    ctime_utc.tm_hour -= 4;
-    ctime_utc.tm_min -= 25;
-    std::mktime(&ctime_utc); // Normalize the time structure
-
-    char buffer[1000];
-    std::strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", &ctime_utc);
-    LogMsg("adjusted utime_utc: %s", buffer);
-
-    const static std::array<int, 4> cycles = {0, 6, 12, 18};
-    int cycle = 0;
-    for (int c : cycles) {
-        if (ctime_utc.tm_hour >= c) {
-            cycle = c;
-        }
+    if (sys_time) {
+        // forecasts of the latest published cycle
+        std::time_t cycle = (t - kPublishDelay) / kCycleLength * kCycleLength;
+        int forecast = (t - cycle) / (kForecastStep * 3600) * kForecastStep;
+        return {{cycle, forecast}, {cycle, forecast + kForecastStep}};
     }
 
-    int adjs = 0;
-    if (ctime_utc.tm_mday != utime_utc.tm_mday) {
-        adjs = 24;
-    }
-    int forecast = (adjs + utime_utc.tm_hour - cycle) / 3 * 3;
+    // the archive has one forecast per cycle so we step through the cycles
+    std::time_t cycle = (t - kHistoricalForecast * 3600) / kCycleLength * kCycleLength;
+    return {{cycle, kHistoricalForecast}, {cycle + kCycleLength, kHistoricalForecast}};
+}
+
+// -> url, url of the plain grib file
+static std::tuple<std::string, std::string>
+GetDownloadUrl(bool sys_time, const GribStep& step)
+{
+    std::tm ctime_utc = *std::gmtime(&step.cycle);
+    int cycle = ctime_utc.tm_hour;
+    int forecast = step.forecast;
 
-    snprintf(buffer, sizeof(buffer), "%d%02d%02d", ctime_utc.tm_year + 1900, ctime_utc.tm_mon + 1, ctime_utc.tm_mday);
+    char buffer[1000];
+    std::strftime(buffer, sizeof(buffer), "%Y%m%d", &ctime_utc);
     std::string cycleDate(buffer);
 
     if (sys_time) {
-        snprintf(buffer, sizeof(buffer), "gfs.t%02dz.pgrb2.0p25.f0%02d", cycle, forecast);
+        snprintf(buffer, sizeof(buffer), "gfs.t%02dz.pgrb2.0p25.f%03d", cycle, forecast);
         std::string filename(buffer);
         LogMsg("NOAA Filename: '%s', %d, %d", filename.c_str(), cycle, forecast);
 
+        snprintf(buffer, sizeof(buffer), "https://nomads.ncep.noaa.gov/pub/data/nccf/com/gfs/prod/gfs.%s/%02d/atmos/%s", cycleDate.c_str(), cycle, filename.c_str());
+        std::string grib_url(buffer);
+
         snprintf(buffer, sizeof(buffer), "https://nomads.ncep.noaa.gov/cgi-bin/filter_gfs_0p25.pl?dir=%%2Fgfs.%s%%2F%02d%%2Fatmos&file=%s&var_SNOD=on&all_lev=on", cycleDate.c_str(), cycle, filename.c_str());
-        return {buffer, ctime_utc, cycle};
+        return {buffer, grib_url};
     } else {
-        forecast = 6; // TODO: for now
-        snprintf(buffer, sizeof(buffer), "gfs.0p25.%s%02d.f0%02d.grib2", cycleDate.c_str(), cycle, forecast);
+        snprintf(buffer, sizeof(buffer), "gfs.0p25.%s%02d.f%03d.grib2", cycleDate.c_str(), cycle, forecast);
         std::string filename(buffer);
         LogMsg("GITHUB Filename: '%s', %d, %d", filename.c_str(), cycle, forecast);
 
         // gh limits to 1000 assets per release, so we have to split per month
         snprintf(buffer, sizeof(buffer), "https://github.com/zodiac1214/weather-data/releases/download/daily-%02d/%s", ctime_utc.tm_mon+1, filename.c_str());
-        return {buffer, ctime_utc, cycle};
+        return {buffer, buffer};
     }
 }
 
-static std::string
-DownloadGribFile(bool sys_time, int month, int day, int hour)
+// in:  user specified time
+// out: time to get snow for, sys_time is switched on for times within the last 24 hours
+static std::time_t
+ProvidedTime(bool& sys_time, int month, int day, int hour, int minute)
 {
-    LogMsg("downloadGribFile: Using system time: %d, month: %d, day: %d, hour: %d", sys_time, month, day, hour);
-
     std::time_t now = std::time(nullptr);
     std::tm now_tm = *std::localtime(&now);
     std::time_t provided_time = now;
@@ -116,7 +162,7 @@ DownloadGribFile(bool sys_time, int month, int day, int hour)
         provided_tm.tm_mon = month - 1; // Adjust month
         provided_tm.tm_mday = day;
         provided_tm.tm_hour = hour;
-        provided_tm.tm_min = 0;
+        provided_tm.tm_min = minute;
         provided_tm.tm_sec = 0;
 
         provided_time = std::mktime(&provided_tm);
@@ -139,27 +185,64 @@ DownloadGribFile(bool sys_time, int month, int day, int hour)
             provided_tm.tm_year = year;
             provided_time = std::mktime(&provided_tm);
         } else {
-            LogMsg("The provided time is within the last 24 hours. Using system time.");
             sys_time = true;
             provided_time = now;
         }
     }
 
-    // now convert provided time to UTC
-    auto ptime_utc_tm = *std::gmtime(&provided_time);
-    char buffer[500];
-    strftime(buffer, sizeof(buffer), "%Y-%m-%d-%H:%M:%S", &ptime_utc_tm);
-    LogMsg("provided time (UTC): %s", buffer);
+    return provided_time;
+}
 
-    auto [url, ctime_utc_tm, cycle] = GetDownloadUrl(sys_time, ptime_utc_tm);
+// -> path of the grib file without extension
+static std::string
+GribFileStem(const GribStep& step)
+{
+    std::tm ctime_utc = *std::gmtime(&step.cycle);
 
     // Get grib file's date date in yyyy-mm-dd format
-    strftime(buffer, sizeof(buffer), "%Y-%m-%d", &ctime_utc_tm);
+    char buffer[50];
+    strftime(buffer, sizeof(buffer), "%Y-%m-%d", &ctime_utc);
     char fn_buffer[500];
-    snprintf(fn_buffer, sizeof(fn_buffer), "%s/%s_%d_noaa.grib2", output_dir.c_str(), buffer, cycle);
-    std::string grib_file_path = fn_buffer;
+    snprintf(fn_buffer, sizeof(fn_buffer), "%s/%s_%d_f%03d_noaa", output_dir.c_str(), buffer, ctime_utc.tm_hour,
+             step.forecast);
+    return fn_buffer;
+}
+
+// -> url, url of the plain grib file, grib file path
+static std::tuple<std::string, std::string, std::string>
+GetGribUrlAndPath(bool sys_time, const GribStep& step)
+{
+    std::time_t valid = step.Valid();
+    auto valid_utc_tm = *std::gmtime(&valid);
+    char buffer[500];
+    strftime(buffer, sizeof(buffer), "%Y-%m-%d-%H:%M:%S", &valid_utc_tm);
+    LogMsg("valid time (UTC): %s", buffer);
+
+    auto [url, grib_url] = GetDownloadUrl(sys_time, step);
+
+    std::string grib_file_path = GribFileStem(step) + ".grib2";
     LogMsg("GRIB file path: '%s'", grib_file_path.c_str());
+    return {url, grib_url, grib_file_path};
+}
 
+// -> success
+static bool
+SaveGribFile(const std::string& grib_file_path, const std::string& data)
+{
+    std::ofstream out (grib_file_path, std::ios::binary);
+    if (!out) {
+        LogMsg("Error creating GRIB file '%s'", grib_file_path.c_str());
+        return false;
+    }
+    out.write(data.data(), data.size());
+    out.close();
+    return true;
+}
+
+// -> success
+static bool
+DownloadGribFile(const std::string& url, const std::string& grib_file_path)
+{
     // if file does not exist, download
     if (!std::filesystem::exists(grib_file_path)) {
         LogMsg("Downloading GRIB file from '%s'", url.c_str());
@@ -168,33 +251,140 @@ DownloadGribFile(bool sys_time, int month, int day, int hour)
         data.reserve(2 * 1024 * 1024);
         if (HttpGet(url, data, 10)) {
             LogMsg("GRIB File downloaded successfully");
-            // save to file
-            std::ofstream out (grib_file_path, std::ios::binary);
-            if (!out) {
-                LogMsg("Error creating GRIB file '%s'", grib_file_path.c_str());
-                return "";
-            }
-            out.write(data.data(), data.size());
-            out.close();
+            return SaveGribFile(grib_file_path, data);
         } else {
             LogMsg("GRIB File download failed");
-            grib_file_path = "";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// NOAA publishes an inventory <grib_url>.idx next to each grib file, one line per message:
+//   1:0:d=2025010100:PRMSL:mean sea level:anl:
+//   2:990253:d=2025010100:CLWMR:1 hybrid level:anl:
+// Messages that hold several fields are listed with sub numbers (5.1, 5.2, ...) and the same offset.
+// fields are given as "<var>:<level>", e.g. "SNOD:surface".
+// -> byte ranges [first, last] of the messages holding fields, last = -1: up to the end of the file
+static std::vector<std::pair<uint64_t, int64_t>>
+GribIdxRanges(const std::string& idx, const std::vector<std::string>& fields)
+{
+    struct Entry {
+        uint64_t offset;
+        std::string line;
+    };
+
+    std::vector<Entry> entries;
+    std::istringstream in(idx);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+
+        size_t colon = line.find(':');
+        if (colon == std::string::npos)
+            continue;
+
+        const char *p = line.c_str() + colon + 1;
+        char *end;
+        uint64_t offset = std::strtoull(p, &end, 10);
+        if (end == p || *end != ':') {
+            LogMsg("invalid idx line: '%s'", line.c_str());
+            continue;
+        }
+
+        entries.push_back({offset, line});
+    }
+
+    std::vector<std::pair<uint64_t, int64_t>> ranges;
+    int64_t last_offset = -1;   // of the last message added, ranges may be merged
+    for (size_t i = 0; i < entries.size(); i++) {
+        const auto& e = entries[i];
+        bool match = false;
+        for (auto& f : fields)
+            match = match || (e.line.find(":" + f + ":") != std::string::npos);
+
+        if (!match)
+            continue;
+
+        // the message ends where the next one starts
+        int64_t last = -1;
+        for (size_t j = i + 1; j < entries.size(); j++)
+            if (entries[j].offset > e.offset) {
+                last = entries[j].offset - 1;
+                break;
+            }
+
+        if ((int64_t)e.offset == last_offset)
+            continue;   // another field of the same message
+
+        last_offset = e.offset;
+
+        // merge adjacent messages into one request
+        if (!ranges.empty() && ranges.back().second + 1 == (int64_t)e.offset)
+            ranges.back().second = last;
+        else
+            ranges.push_back({e.offset, last});
+    }
+
+    return ranges;
+}
+
+// download only the messages holding fields by HTTP range requests
+// -> success
+bool
+DownloadGribFileIdx(const std::string& grib_url, const std::string& grib_file_path,
+                    const std::vector<std::string>& fields)
+{
+    if (std::filesystem::exists(grib_file_path))
+        return true;
+
+    std::string idx_url = grib_url + ".idx";
+    LogMsg("Downloading GRIB inventory from '%s'", idx_url.c_str());
+
+    std::string idx;
+    if (!HttpGet(idx_url, idx, 10)) {
+        LogMsg("GRIB inventory download failed");
+        return false;
+    }
+
+    auto ranges = GribIdxRanges(idx, fields);
+    if (ranges.empty()) {
+        LogMsg("Requested fields are not in the GRIB inventory");
+        return false;
+    }
+
+    std::string data;
+    for (auto [first, last] : ranges) {
+        size_t ofs = data.size();
+        if (!HttpGetRange(grib_url, first, last, data, 10))
+            return false;
+
+        if (data.compare(ofs, 4, "GRIB") != 0) {
+            LogMsg("Range %llu-%lld of '%s' is not a GRIB message",
+                   (unsigned long long)first, (long long)last, grib_url.c_str());
+            return false;
         }
     }
 
-    return grib_file_path;
+    LogMsg("GRIB messages downloaded successfully, %d ranges, %d bytes", (int)ranges.size(), (int)data.size());
+    return SaveGribFile(grib_file_path, data);
 }
 
+// remove grib files and snapshots that don't start with one of files_to_keep
 static void
-RemoveOldGribFiles(std::string file_to_keep)
+RemoveOldGribFiles(std::vector<std::string> files_to_keep)
 {
+    LogMsg("Removing old grib files");
     // posixify filenames for textual comparison
+    for (auto& file_to_keep : files_to_keep) {
 #if IBM == 1
-    std::replace(file_to_keep.begin(), file_to_keep.end(), '\\', '/');
+        std::replace(file_to_keep.begin(), file_to_keep.end(), '\\', '/');
 #endif
+        LogMsg("File to keep: %s", file_to_keep.c_str());
+    }
 
-    LogMsg("Removing old grib files");
-    LogMsg("File to keep: %s", file_to_keep.c_str());
     LogMsg("Grib file folder: %s", output_dir.c_str());
 
     try {
@@ -203,10 +393,19 @@ RemoveOldGribFiles(std::string file_to_keep)
 #if IBM == 1
             std::replace(path.begin(), path.end(), '\\', '/');
 #endif
-            // Check for files with .grib extension
-            if (path.find("_noaa.grib2") != std::string::npos && path.find(file_to_keep) == std::string::npos) {
-                std::filesystem::remove(path);
-                LogMsg("Removed: %s", path.c_str());
+            bool keep = false;
+            for (auto& file_to_keep : files_to_keep)
+                keep = keep || (path.find(file_to_keep) != std::string::npos);
+
+            // Check for files with .grib2 or .snod extension
+            if ((path.find("_noaa.grib2") != std::string::npos || path.find("_noaa.snod") != std::string::npos)
+                && !keep) {
+                // a snapshot may still be mapped by the active map (Windows)
+                std::error_code ec;
+                if (std::filesystem::remove(path, ec))
+                    LogMsg("Removed: %s", path.c_str());
+                else
+                    LogMsg("Can't remove: %s", path.c_str());
             }
         }
     } catch (const std::exception& e) {
@@ -223,46 +422,107 @@ static const char *wgrib2 =
 "/OSX11wgrib2";
 #endif
 
+static const char *null_device =
+#if IBM == 1
+"NUL";
+#else
+"/dev/null";
+#endif
+
+// export grib file to csv with wgrib2 and stream that directly into map
+bool
+LoadGribWgrib2(DepthMap& map, const std::string& grib_file_path)
+{
+    // 0:1440:0.25 means scan longitude from 0, 1440 steps with step 0.25 degree
+    // -90:721:0.25 means scan latitude from -90, 721 steps with step 0.25 degree
+    // csv output goes to stdout and the inventory that is written there by default goes to the null device
+    std::string cmd = "\"" + plugin_dir + "/bin" + wgrib2
+        + "\" -inv " + null_device + " -lola 0:1440:0.25 -90:721:0.25 - spread \"" + grib_file_path + "\" -match_fs SNOD";
+
+    LogMsg("cmd:'%s'", cmd.c_str());
+
+    // parse while wgrib2 is still decoding
+    DepthMap::CSVStream csv_stream(map);
+    int ex = sub_exec(cmd, [&csv_stream] (const char *data, size_t len) { csv_stream.Feed(data, len); });
+    if (ex != 0)
+        return false;
+
+    return csv_stream.Finish() > 0;
+}
+
 // Runs async
 static bool
-DownloadAndProcessGribFile(bool sys_time, int month, int day, int hour)
+DownloadAndProcessGribFile(bool sys_time, const GribStep& step, const std::vector<std::string>& files_to_keep,
+                           const std::string& png_path)
 {
     const char *snod_csv_name = std::getenv("USE_SNOD_CSV");
 
     if (NULL == snod_csv_name) {
-        std::string grib_file_path = DownloadGribFile(sys_time, month, day, hour);
-        if (grib_file_path.size() == 0)
+        auto [url, grib_url, grib_file_path] = GetGribUrlAndPath(sys_time, step);
+        bool use_wgrib2 = (std::getenv("USE_WGRIB2") != nullptr);
+        bool use_grib_idx = (std::getenv("USE_GRIB_IDX") != nullptr);
+
+        // the final map of a grib file is saved as snapshot next to it
+        std::string grib_file_stem = grib_file_path.substr(0, grib_file_path.size() - strlen(".grib2"));
+        std::string snapshot_path = grib_file_stem + ".snod";
+        std::string source = std::filesystem::path(grib_file_path).filename().string();
+
+        if (!use_wgrib2) {
+            auto map = DepthMap::LoadSnapshot(snapshot_path, source);
+            if (map) {
+                // the png may be from another map by now, a next map is only needed for interpolation
+                new_snod_map = std::move(map);
+                if (png_path != kNextPngName)
+                    CreateSnowMapPng(*new_snod_map, png_path);
+                return true;
+            }
+        }
+
+        // the selective download falls back to the full one if the inventory is not available
+        if (!(use_grib_idx && DownloadGribFileIdx(grib_url, grib_file_path, {"SNOD:surface"}))
+            && !DownloadGribFile(url, grib_file_path))
             return false;
 
-        snod_csv_name = "snod.csv";
+        // create new snow map
+        new_snod_map = std::make_unique<DepthMap>(kSnodResolution);
 
-        // export grib file to csv
-        // 0:3600:0.25 means scan longitude from 0, 3600 steps with step 0.25 degree
-        // -90:1800:0.25 means scan latitude from -90, 1800 steps with step 0.25 degree
-        std::string cmd = "\"" + plugin_dir + "/bin" + wgrib2
-            + "\" -s -lola 0:3600:0.25 -90:1800:0.25 \"" + snod_csv_name + "\" spread \"" + grib_file_path + "\" -match_fs SNOD";
+        // The native decoder does not support all packings (e.g. JPEG2000),
+        // in that case or when requested we use wgrib2
+        if (use_wgrib2 || !new_snod_map->LoadGrib(grib_file_path)) {
+            if (!use_wgrib2) {
+                LogMsg("Native GRIB decoding failed, falling back to wgrib2");
+                new_snod_map = std::make_unique<DepthMap>(kSnodResolution);
+            }
 
-        LogMsg("cmd:'%s'", cmd.c_str());
-        int ex = sub_exec(cmd);
-        if (ex != 0)
-            return false;
+            if (!LoadGribWgrib2(*new_snod_map, grib_file_path))
+                return false;
+        }
+
+        new_snod_map->Compact();
+        if (new_snod_map->SaveSnapshot(snapshot_path, source)) {
+            // continue with the mapped snapshot, that keeps the heap small with 2 resident maps
+            auto map = DepthMap::LoadSnapshot(snapshot_path, source);
+            if (map)
+                new_snod_map = std::move(map);
+        }
 
-        RemoveOldGribFiles(grib_file_path);
-    } else
+        RemoveOldGribFiles(files_to_keep);
+    } else {
         LogMsg("Using existing snod_csv file '%s'", snod_csv_name);
+        new_snod_map = std::make_unique<DepthMap>(kSnodResolution);
+        new_snod_map->LoadCSV(snod_csv_name);
+        new_snod_map->Compact();
+    }
 
-    // create new snow map
-    new_snod_map = std::make_unique<DepthMap>(0.25f);
-    new_snod_map->LoadCSV(snod_csv_name);
-    CreateSnowMapPng(*new_snod_map, "snow_depth.png");
+    CreateSnowMapPng(*new_snod_map, png_path);
     return true;
 }
 
 static bool
-AsyncDownloadAndProcess(bool sys_time, int month, int day, int hour)
+AsyncDownloadAndProcess(bool sys_time, GribStep step, std::vector<std::string> files_to_keep, std::string png_path)
 {
     for (int i = 0; i < 3; i++) {
-        bool res = DownloadAndProcessGribFile(sys_time, month, day, hour);
+        bool res = DownloadAndProcessGribFile(sys_time, step, files_to_keep, png_path);
         if (!res) {
             LogMsg("Download grib file failed, retry: %d", i);
         } else {
@@ -279,16 +539,90 @@ AsyncDownloadAndProcess(bool sys_time, int month, int day, int hour)
 // Logically these routines belong to xa-snow.cpp but that would create a reference
 // to XPML_64 for grib_test.cpp so we leave them here
 
+static void
+StartDownload(DownloadMode mode, bool sys_time, const GribStep& step)
+{
+    download_mode = mode;
+    download_step = step;
+    download_sys_time = sys_time;
+
+    // the grib file being downloaded and those of the resident maps
+    std::vector<std::string> files_to_keep{GribFileStem(step), GribFileStem(snod_step), GribFileStem(next_step)};
+    std::string png_path = kPngName;
+    if (mode == DownloadMode::kNext) {
+        // a next map from a snapshot comes without png, so never leave an older one behind
+        png_path = kNextPngName;
+        std::error_code ec;
+        std::filesystem::remove(png_path, ec);
+    }
+
+    download_future = std::async(std::launch::async, AsyncDownloadAndProcess, sys_time, step, files_to_keep, png_path);
+    download_active = true;
+}
+
 // start download in the background
 void
 StartAsyncDownload(bool sys_time, int month, int day, int hour)
 {
+    LogMsg("StartAsyncDownload: Using system time: %d, month: %d, day: %d, hour: %d", sys_time, month, day, hour);
+    bool requested_sys_time = sys_time;
+    snow_time = ProvidedTime(sys_time, month, day, hour, 0);
+    if (sys_time && !requested_sys_time)
+        LogMsg("The provided time is within the last 24 hours. Using system time.");
+    snow_sys_time = sys_time;
+
+    // the next map may be for a different mode
+    next_snod_map = nullptr;
+    GribStep step = GribSteps(sys_time, snow_time).first;
+
     if (download_active) {
-        LogMsg("Download is already in progress, request ignored");
+        // the result of the active download is discarded
+        LogMsg("Download is already in progress, request queued");
+        load_pending = true;
+        load_pending_sys_time = sys_time;
+        load_pending_step = step;
+        return;
     }
 
-    download_future = std::async(std::launch::async, AsyncDownloadAndProcess, sys_time, month, day, hour);
-    download_active = true;
+    StartDownload(DownloadMode::kLoad, sys_time, step);
+}
+
+// Called now and then by the flightloop with the sim clock.
+// Keeps the maps of the 2 forecast steps around the sim clock resident,
+// the next one is downloaded while the current one is in use.
+void
+ScheduleGribDownload(bool sys_time, int month, int day, int hour, int minute)
+{
+    snow_time = ProvidedTime(sys_time, month, day, hour, minute);
+    snow_sys_time = sys_time;
+    auto [step, step_next] = GribSteps(sys_time, snow_time);
+
+    if (next_snod_map && next_sys_time != sys_time) {
+        LogMsg("Dropping the prefetched snow map of the other mode");
+        next_snod_map = nullptr;
+    }
+
+    if (next_snod_map && next_step == step) {
+        LogMsg("Sim clock reached the next forecast step");
+        snod_map = std::move(next_snod_map);
+        snod_step = next_step;
+
+        // not there if the map came from a snapshot or if a prefetch is writing it
+        std::error_code ec;
+        if (!(download_active && download_mode == DownloadMode::kNext) && std::filesystem::exists(kNextPngName, ec))
+            std::filesystem::rename(kNextPngName, kPngName, ec);
+    }
+
+    if (download_active || std::time(nullptr) < retry_after)
+        return;
+
+    if (snod_map == nullptr || snod_step != step) {
+        LogMsg("Updating snow map to the current forecast step");
+        StartDownload(DownloadMode::kCurrent, sys_time, step);
+    } else if (next_snod_map == nullptr || next_step != step_next) {
+        LogMsg("Prefetching snow map of the next forecast step");
+        StartDownload(DownloadMode::kNext, sys_time, step_next);
+    }
 }
 
 //
@@ -304,8 +638,64 @@ CheckAsyncDownload()
         download_active = false;
         bool res = download_future.get();
         LogMsg("CheckAsyncDownload(): Download status: %d", res);
-        snod_map = std::move(new_snod_map);     // activate the new map
+
+        if (load_pending) {
+            LogMsg("Discarding the result, starting the queued request");
+            load_pending = false;
+            new_snod_map = nullptr;
+            retry_after = 0;
+            StartDownload(DownloadMode::kLoad, load_pending_sys_time, load_pending_step);
+            return download_active;
+        }
+
+        if (!res)
+            retry_after = std::time(nullptr) + kRetryDelay;
+
+        if (res && (download_mode == DownloadMode::kLoad || download_mode == DownloadMode::kCurrent)) {
+            snod_map = std::move(new_snod_map);     // activate the new map
+            snod_step = download_step;
+        } else if (!res && download_mode == DownloadMode::kLoad) {
+            // the old map is for another time, so wait for the retry without snow
+            snod_map = nullptr;
+            snod_step = GribStep();
+        } else if (res && download_mode == DownloadMode::kNext) {
+            // the sim clock or the mode may have changed meanwhile
+            if (download_sys_time == snow_sys_time && download_step == GribSteps(snow_sys_time, snow_time).second) {
+                next_snod_map = std::move(new_snod_map);
+                next_step = download_step;
+                next_sys_time = download_sys_time;
+            } else
+                LogMsg("Prefetched snow map is stale, discarded");
+        }
+
+        new_snod_map = nullptr;
     }
 
     return download_active;
 }
+
+// e.g. on disable, a running download is collected as usual
+void
+ResetSnowMaps()
+{
+    snod_map = nullptr;
+    snod_step = GribStep();
+    next_snod_map = nullptr;
+    next_step = GribStep();
+}
+
+// snow depth at lon, lat, linearly interpolated in time between the resident maps
+// -> snow depth, is_extended
+std::tuple<float, bool>
+GetSnowDepth(float lon, float lat)
+{
+    auto [sd, is_extended] = snod_map->Get(lon, lat);
+    if (next_snod_map == nullptr || next_step.Valid() <= snod_step.Valid())
+        return {sd, is_extended};
+
+    float w = float(snow_time - snod_step.Valid()) / float(next_step.Valid() - snod_step.Valid());
+    w = std::clamp(w, 0.0f, 1.0f);
+
+    auto [sd_next, is_extended_next] = next_snod_map->Get(lon, lat);
+    return {(1.0f - w) * sd + w * sd_next, w < 0.5f ? is_extended : is_extended_next};
+}
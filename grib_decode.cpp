@@ -0,0 +1,582 @@
+//
+//    X Airline Snow: show accumulated snow in X-Plane's world
+//
+//    Copyright (C) 2025  Holger Teutsch
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+// Reference: WMO Manual on Codes, FM 92 GRIB edition 2
+// Octet numbers in comments are 1-based as in the WMO tables, so octet n is at p[n - 1].
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "xa-snow.h"
+#include "grib_decode.h"
+
+#include <spng.h> // For image processing, include after xa-snow.h
+
+static inline uint32_t
+U16(const uint8_t *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static inline uint32_t
+U32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static inline uint64_t
+U64(const uint8_t *p)
+{
+    return ((uint64_t)U32(p) << 32) | U32(p + 4);
+}
+
+// GRIB uses sign and magnitude for negative numbers
+static inline int32_t
+S16(const uint8_t *p)
+{
+    int32_t v = U16(p) & 0x7fff;
+    return (p[0] & 0x80) ? -v : v;
+}
+
+static inline int32_t
+S32(const uint8_t *p)
+{
+    int32_t v = U32(p) & 0x7fffffff;
+    return (p[0] & 0x80) ? -v : v;
+}
+
+static inline int64_t
+SN(const uint8_t *p, int n)
+{
+    int64_t v = p[0] & 0x7f;
+    for (int i = 1; i < n; i++)
+        v = (v << 8) | p[i];
+    return (p[0] & 0x80) ? -v : v;
+}
+
+static inline float
+IEEE(const uint8_t *p)
+{
+    uint32_t u = U32(p);
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+// read big-endian bit fields of up to 32 bits
+class BitReader {
+    const uint8_t *p_;
+    size_t len_;
+    size_t pos_{0};         // in bits
+    bool overrun_{false};
+
+  public:
+    BitReader(const uint8_t *p, size_t len) : p_(p), len_(len) {}
+
+    uint32_t Get(int nbits) {
+        if (nbits == 0)
+            return 0;
+
+        if (pos_ + nbits > len_ * 8) {
+            overrun_ = true;
+            return 0;
+        }
+
+        size_t i = pos_ >> 3;
+        int shift = pos_ & 7;
+        uint64_t v = 0;
+        for (int k = 0; k < 5; k++)
+            v = (v << 8) | (i + k < len_ ? p_[i + k] : 0);
+
+        pos_ += nbits;
+        return (v >> (40 - shift - nbits)) & ((1ULL << nbits) - 1);
+    }
+
+    void Align() { pos_ = (pos_ + 7) & ~(size_t)7; }
+    bool Overrun() const { return overrun_; }
+};
+
+// the sections of a field we are interested in
+struct Sections {
+    int discipline;
+    const uint8_t *s3, *s4, *s5, *s6, *s7;
+    uint32_t len3, len4, len5, len7;
+};
+
+static bool
+DecodeGrid(const uint8_t *s3, uint32_t len3, GribField& field)
+{
+    if (len3 < 14) {
+        LogMsg("GRIB: section 3 too short: %u", len3);
+        return false;
+    }
+
+    int tmpl = U16(s3 + 12);
+    if (tmpl != 0) {
+        LogMsg("GRIB: unsupported grid template 3.%d", tmpl);
+        return false;
+    }
+
+    if (len3 < 72) {
+        LogMsg("GRIB: section 3 too short for template 3.0: %u", len3);
+        return false;
+    }
+
+    field.ni = U32(s3 + 30);
+    field.nj = U32(s3 + 34);
+
+    // angles are in micro degrees unless a basic angle/subdivision is given
+    double unit = 1.0e-6;
+    uint32_t basic_angle = U32(s3 + 38);
+    uint32_t subdivisions = U32(s3 + 42);
+    if (basic_angle != 0 && basic_angle != 0xffffffff && subdivisions != 0 && subdivisions != 0xffffffff)
+        unit = (double)basic_angle / subdivisions;
+
+    field.lat0 = S32(s3 + 46) * unit;
+    field.lon0 = S32(s3 + 50) * unit;
+    double di = U32(s3 + 63) * unit;
+    double dj = U32(s3 + 67) * unit;
+
+    // code table 3.4
+    int scan = s3[71];
+    if (scan & 0x10) {
+        LogMsg("GRIB: unsupported scanning mode %02x", scan);
+        return false;
+    }
+
+    field.dlon = (scan & 0x80) ? -di : di;
+    field.dlat = (scan & 0x40) ? dj : -dj;
+    field.i_consecutive = ((scan & 0x20) == 0);
+    return true;
+}
+
+// template 5.0
+static bool
+UnpackSimple(const Sections& sec, int n, std::vector<int64_t>& x)
+{
+    int nbits = sec.s5[19];
+    if (nbits > 32)
+        return false;
+
+    BitReader br(sec.s7 + 5, sec.len7 - 5);
+    for (int i = 0; i < n; i++)
+        x[i] = br.Get(nbits);
+
+    return !br.Overrun();
+}
+
+// template 5.41
+static bool
+UnpackPng(const Sections& sec, int n, std::vector<int64_t>& x)
+{
+    int nbits = sec.s5[19];
+    if (nbits > 32)
+        return false;
+
+    if (nbits == 0) {
+        std::fill(x.begin(), x.end(), 0);
+        return true;
+    }
+
+    spng_ctx *ctx = spng_ctx_new(0);
+    if (ctx == nullptr)
+        return false;
+
+    spng_set_png_buffer(ctx, sec.s7 + 5, sec.len7 - 5);
+
+    bool res = false;
+    struct spng_ihdr ihdr;
+    size_t img_size;
+    std::unique_ptr<uint8_t[]> img;
+    int ret = spng_get_ihdr(ctx, &ihdr);
+    if (ret) {
+        LogMsg("GRIB: spng_get_ihdr() error: %s", spng_strerror(ret));
+        goto out;
+    }
+
+    if ((int)(ihdr.width * ihdr.height) != n) {
+        LogMsg("GRIB: PNG size mismatch %d x %d != %d", ihdr.width, ihdr.height, n);
+        goto out;
+    }
+
+    // raw = big endian and rows are padded to full bytes
+    spng_decoded_image_size(ctx, SPNG_FMT_RAW, &img_size);
+    img = std::make_unique<uint8_t[]>(img_size);
+    ret = spng_decode_image(ctx, img.get(), img_size, SPNG_FMT_RAW, 0);
+    if (ret) {
+        LogMsg("GRIB: spng_decode_image() error: %s", spng_strerror(ret));
+        goto out;
+    }
+
+    {
+        size_t row_len = img_size / ihdr.height;
+        int k = 0;
+        for (uint32_t j = 0; j < ihdr.height; j++) {
+            BitReader br(img.get() + j * row_len, row_len);
+            for (uint32_t i = 0; i < ihdr.width; i++)
+                x[k++] = br.Get(nbits);
+        }
+    }
+
+    res = true;
+
+  out:
+    spng_ctx_free(ctx);
+    return res;
+}
+
+// templates 5.2 and 5.3
+static bool
+UnpackComplex(const Sections& sec, int n, std::vector<int64_t>& x, std::vector<bool>& missing)
+{
+    const uint8_t *s5 = sec.s5;
+    int tmpl = U16(s5 + 9);
+
+    int nbits = s5[19];
+    int miss_mgmt = s5[22];
+    uint32_t ng = U32(s5 + 31);
+    uint32_t width_ref = s5[35];
+    int width_bits = s5[36];
+    uint32_t len_ref = U32(s5 + 37);
+    uint32_t len_incr = s5[41];
+    uint32_t len_last = U32(s5 + 42);
+    int len_bits = s5[46];
+
+    int sd_order = 0, sd_octets = 0;
+    if (tmpl == 3) {
+        sd_order = s5[47];
+        sd_octets = s5[48];
+        if (sd_order < 1 || sd_order > 2) {
+            LogMsg("GRIB: invalid order of spatial differencing: %d", sd_order);
+            return false;
+        }
+    }
+
+    if (miss_mgmt > 2 || ng == 0 || nbits > 32 || width_bits > 32 || len_bits > 32) {
+        LogMsg("GRIB: invalid complex packing, miss_mgmt: %d, ng: %d", miss_mgmt, ng);
+        return false;
+    }
+
+    const uint8_t *p = sec.s7 + 5;
+    const uint8_t *p_end = sec.s7 + sec.len7;
+
+    // extra descriptors for spatial differencing
+    int64_t sd_init[2] = {0, 0}, sd_min = 0;
+    if (sd_order > 0) {
+        if (p + (sd_order + 1) * sd_octets > p_end)
+            return false;
+
+        for (int i = 0; i < sd_order; i++, p += sd_octets)
+            sd_init[i] = SN(p, sd_octets);
+
+        sd_min = SN(p, sd_octets);
+        p += sd_octets;
+    }
+
+    BitReader br(p, p_end - p);
+
+    std::vector<uint32_t> g_ref(ng), g_width(ng), g_len(ng);
+    for (uint32_t g = 0; g < ng; g++)
+        g_ref[g] = br.Get(nbits);
+    br.Align();
+
+    for (uint32_t g = 0; g < ng; g++)
+        g_width[g] = width_ref + br.Get(width_bits);
+    br.Align();
+
+    int64_t total = 0;
+    for (uint32_t g = 0; g < ng; g++) {
+        g_len[g] = len_ref + br.Get(len_bits) * len_incr;
+        if (g == ng - 1)
+            g_len[g] = len_last;
+        total += g_len[g];
+    }
+    br.Align();
+
+    if (br.Overrun() || total != n) {
+        LogMsg("GRIB: inconsistent group descriptors, total: %lld, n: %d", (long long)total, n);
+        return false;
+    }
+
+    // missing values are coded as all bits set (primary) or all bits set - 1 (secondary)
+    uint32_t miss_g1 = (uint32_t)((1ULL << nbits) - 1);
+    uint32_t miss_g2 = miss_g1 - 1;
+
+    int k = 0;
+    for (uint32_t g = 0; g < ng; g++) {
+        uint32_t w = g_width[g];
+        uint32_t ref = g_ref[g];
+        if (w == 0) {
+            bool m = (miss_mgmt >= 1 && ref == miss_g1) || (miss_mgmt == 2 && ref == miss_g2);
+            for (uint32_t i = 0; i < g_len[g]; i++, k++) {
+                x[k] = ref;
+                missing[k] = m;
+            }
+            continue;
+        }
+
+        if (w > 32)
+            return false;
+
+        uint32_t miss_1 = (uint32_t)((1ULL << w) - 1);
+        uint32_t miss_2 = miss_1 - 1;
+        for (uint32_t i = 0; i < g_len[g]; i++, k++) {
+            uint32_t v = br.Get(w);
+            x[k] = (int64_t)ref + v;
+            missing[k] = (miss_mgmt >= 1 && v == miss_1) || (miss_mgmt == 2 && v == miss_2);
+        }
+    }
+
+    if (br.Overrun()) {
+        LogMsg("GRIB: data section overrun");
+        return false;
+    }
+
+    if (sd_order == 0)
+        return true;
+
+    // undo spatial differencing, missing values are not part of the sequence
+    int64_t x1 = 0, x2 = 0;     // previous values
+    int cnt = 0;
+    for (int i = 0; i < n; i++) {
+        if (missing[i])
+            continue;
+
+        if (cnt < sd_order)
+            x[i] = sd_init[cnt];
+        else if (sd_order == 1)
+            x[i] = x[i] + sd_min + x1;
+        else
+            x[i] = x[i] + sd_min + 2 * x1 - x2;
+
+        x2 = x1;
+        x1 = x[i];
+        cnt++;
+    }
+
+    return true;
+}
+
+static bool
+DecodeData(const Sections& sec, GribField& field)
+{
+    static constexpr int64_t kMaxPoints = 100'000'000;     // GFS 0.25° has ~ 1e6
+
+    const uint8_t *s5 = sec.s5;
+    if (sec.len5 < 11) {
+        LogMsg("GRIB: section 5 too short: %u", sec.len5);
+        return false;
+    }
+
+    uint32_t n_values = U32(s5 + 5);
+    int tmpl = U16(s5 + 9);
+
+    // the octets read by the unpackers, templates 5.0 and 5.41 also have octet 21
+    uint32_t min_len5 = 0;
+    switch (tmpl) {
+        case 0: case 41: min_len5 = 21; break;
+        case 2: min_len5 = 47; break;
+        case 3: min_len5 = 49; break;
+    }
+
+    if (sec.len5 < min_len5) {
+        LogMsg("GRIB: section 5 too short for template 5.%d: %u", tmpl, sec.len5);
+        return false;
+    }
+
+    // ni, nj are U32 in the file
+    int64_t n_points_64 = (int64_t)field.ni * field.nj;
+    if (field.ni <= 0 || field.nj <= 0 || n_points_64 > kMaxPoints) {
+        LogMsg("GRIB: invalid grid size %d x %d", field.ni, field.nj);
+        return false;
+    }
+
+    int n_points = n_points_64;
+    if (n_values > (uint32_t)n_points) {
+        LogMsg("GRIB: # of values %u > # of grid points %d", n_values, n_points);
+        return false;
+    }
+
+    int n = n_values;
+
+    std::vector<int64_t> x(n);
+    std::vector<bool> missing(n);
+
+    bool ok;
+    switch (tmpl) {
+        case 0:
+            ok = UnpackSimple(sec, n, x);
+            break;
+
+        case 2:
+        case 3:
+            ok = UnpackComplex(sec, n, x, missing);
+            break;
+
+        case 41:
+            ok = UnpackPng(sec, n, x);
+            break;
+
+        default:
+            LogMsg("GRIB: unsupported data template 5.%d", tmpl);
+            return false;
+    }
+
+    if (!ok)
+        return false;
+
+    // Y = (R + X * 2^E) / 10^D
+    double ref = IEEE(s5 + 11);
+    double bin_scale = std::ldexp(1.0, S16(s5 + 15));
+    double dec_scale = std::pow(10.0, -S16(s5 + 17));
+
+    // scatter through the bitmap
+    const uint8_t *bitmap = nullptr;
+    if (sec.s6 != nullptr) {
+        uint32_t s6_len = U32(sec.s6);
+        if (s6_len < 6) {
+            LogMsg("GRIB: invalid bitmap section length %u", s6_len);
+            return false;
+        }
+
+        if (sec.s6[5] == 0) {
+            if (s6_len < 6 + ((uint32_t)n_points + 7) / 8) {
+                LogMsg("GRIB: bitmap section too short, %u bytes for %d grid points", s6_len, n_points);
+                return false;
+            }
+
+            bitmap = sec.s6 + 6;
+        }
+    }
+
+    if (bitmap == nullptr && n != n_points) {
+        LogMsg("GRIB: no bitmap but # of values %d != # of grid points %d", n, n_points);
+        return false;
+    }
+
+    field.val = std::make_unique<float[]>(n_points);
+    field.defined = std::make_unique<bool[]>(n_points);
+    field.n_defined = 0;
+
+    int k = 0;
+    for (int i = 0; i < n_points; i++) {
+        if (bitmap && !(bitmap[i >> 3] & (0x80 >> (i & 7))))
+            continue;
+
+        if (k >= n) {
+            LogMsg("GRIB: bitmap has more points than values");
+            return false;
+        }
+
+        if (!missing[k]) {
+            field.val[i] = (ref + x[k] * bin_scale) * dec_scale;
+            field.defined[i] = true;
+            field.n_defined++;
+        }
+        k++;
+    }
+
+    return true;
+}
+
+bool
+GribDecode(const uint8_t *buf, size_t len, const GribParam& param, GribField& field)
+{
+    const uint8_t *p = buf;
+    const uint8_t *end = buf + len;
+
+    while (p + 16 <= end) {
+        // section 0
+        if (memcmp(p, "GRIB", 4) != 0) {
+            p++;    // resync, there may be junk in between
+            continue;
+        }
+
+        uint64_t msg_len = U64(p + 8);
+        if (p[7] != 2 || msg_len < 16 + 4 || msg_len > (uint64_t)(end - p)) {
+            LogMsg("GRIB: invalid message header, edition: %d, length: %llu", p[7], (unsigned long long)msg_len);
+            return false;
+        }
+
+        const uint8_t *msg_end = p + msg_len;
+        Sections sec{};
+        sec.discipline = p[6];
+
+        // a message may contain several fields by repeating sections 2..7 or 3..7 or 4..7
+        const uint8_t *s = p + 16;
+        while (s + 5 <= msg_end && memcmp(s, "7777", 4) != 0) {
+            uint32_t s_len = U32(s);
+            if (s_len < 5 || s_len > (uint32_t)(msg_end - s)) {
+                LogMsg("GRIB: invalid section length");
+                return false;
+            }
+
+            switch (s[4]) {
+                case 3: sec.s3 = s; sec.len3 = s_len; break;
+                case 4: sec.s4 = s; sec.len4 = s_len; break;
+                case 5: sec.s5 = s; sec.len5 = s_len; break;
+                case 6:
+                    if (s_len < 6) {
+                        LogMsg("GRIB: section 6 too short: %u", s_len);
+                        return false;
+                    }
+
+                    // 254 = reuse the previously defined bitmap
+                    if (s[5] != 254)
+                        sec.s6 = s;
+                    break;
+
+                case 7:
+                    sec.s7 = s;
+                    sec.len7 = s_len;
+                    if (sec.s3 && sec.s4 && sec.s5 && sec.len4 < 11) {
+                        LogMsg("GRIB: section 4 too short: %u", sec.len4);
+                        return false;
+                    }
+
+                    if (sec.s3 && sec.s4 && sec.s5
+                        && sec.discipline == param.discipline
+                        && sec.s4[9] == param.category && sec.s4[10] == param.number) {
+                        if (!DecodeGrid(sec.s3, sec.len3, field))
+                            return false;
+                        if (!DecodeData(sec, field))
+                            return false;
+
+                        LogMsg("GRIB: decoded field %d/%d/%d, template 5.%d, %d x %d, %d defined points",
+                               param.discipline, param.category, param.number, U16(sec.s5 + 9),
+                               field.ni, field.nj, field.n_defined);
+                        return true;
+                    }
+                    break;
+            }
+
+            s += s_len;
+        }
+
+        p = msg_end;
+    }
+
+    LogMsg("GRIB: field %d/%d/%d not found", param.discipline, param.category, param.number);
+    return false;
+}
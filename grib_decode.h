@@ -0,0 +1,72 @@
+//
+//    X Airline Snow: show accumulated snow in X-Plane's world
+//
+//    Copyright (C) 2025  Holger Teutsch
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+#ifndef _GRIB_DECODE_H_
+#define _GRIB_DECODE_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+// A minimal GRIB2 reader for what NOAA publishes for GFS 0.25° fields:
+// grid template 3.0 (regular lat/lon) with
+// data templates 5.0 (simple), 5.2 (complex), 5.3 (complex + spatial differencing) and 5.41 (PNG).
+// 5.40 (JPEG2000) is not supported, the caller has to fall back to wgrib2.
+
+// GRIB2 parameter = (discipline, category, number), see WMO code table 4.2
+struct GribParam {
+    int discipline, category, number;
+};
+
+static constexpr GribParam kGribSNOD{0, 1, 11};     // snow depth [m]
+static constexpr GribParam kGribICEC{10, 2, 0};     // ice cover [proportion]
+static constexpr GribParam kGribTMP{0, 0, 0};       // temperature [K]
+
+struct GribField {
+    int ni{0}, nj{0};           // # of points along a parallel, meridian
+    double lon0, lat0;          // first grid point
+    double dlon, dlat;          // signed increments in scan direction
+    bool i_consecutive{true};   // adjacent points are along a parallel
+
+    std::unique_ptr<float[]> val;       // ni * nj values in scan order
+    std::unique_ptr<bool[]> defined;    // false = missing by bitmap or missing value management
+
+    int n_defined{0};
+
+    // -> lon, lat of point k in scan order
+    void LonLat(int k, float& lon, float& lat) const {
+        int i, j;
+        if (i_consecutive) {
+            i = k % ni;
+            j = k / ni;
+        } else {
+            i = k / nj;
+            j = k % nj;
+        }
+
+        lon = lon0 + i * dlon;
+        lat = lat0 + j * dlat;
+    }
+};
+
+// find the first field of param in buf and decode it -> success
+extern bool GribDecode(const uint8_t *buf, size_t len, const GribParam& param, GribField& field);
+#endif
@@ -26,8 +26,16 @@
 #include <iostream>
 #include <thread>
 #include <chrono>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <filesystem>
 #include <stdio.h>
 
+#include <zlib.h>
+
 #include "xa-snow.h"
 #include "depth_map.h"
 #include "coast_map.h"
@@ -57,6 +65,216 @@ probe_nearest_land(float lat, float lon)
 
 }
 
+// -> # of points that differ
+// csv values have 6 significant digits, compact maps are rounded to mm
+static int
+compare_maps(const DepthMap& map_1, const DepthMap& map_2, const char *what, float tolerance = 1.0e-4f)
+{
+    float max_diff = 0.0f;
+    int n_diff = 0;
+    for (int i = 0; i < 3600; i++) {
+        for (int j = 0; j < 1800; j++) {
+            float lon = i * 0.1f;
+            float lat = j * 0.1f - 90.0f;
+            auto [sd_1, ext_1] = map_1.Get(lon, lat);
+            auto [sd_2, ext_2] = map_2.Get(lon, lat);
+            float diff = std::abs(sd_1 - sd_2);
+            max_diff = std::max(max_diff, diff);
+            if (diff > tolerance || ext_1 != ext_2)
+                n_diff++;
+        }
+    }
+
+    LogMsg("%s: max_diff: %g, # of differing points: %d", what, max_diff, n_diff);
+    return n_diff;
+}
+
+// GetMany() must give bit identical results to Get()
+// -> # of differing points
+static int
+compare_get_many(const DepthMap& map, const char *what)
+{
+    // a grid including the poles and the dateline plus some odd positions
+    std::vector<float> lon, lat;
+    for (int j = 0; j <= 180 * 7; j++)
+        for (int i = 0; i < 360 * 7; i++) {
+            lon.push_back(i / 7.0f - 180.0f);
+            lat.push_back(j / 7.0f - 90.0f);
+        }
+
+    for (float l : {-180.0f, -0.0f, 0.0f, 179.999f, 359.9f, 360.0f}) {
+        lon.push_back(l);
+        lat.push_back(90.0f);
+        lon.push_back(l);
+        lat.push_back(-90.0f);
+    }
+
+    int n = lon.size();
+    auto sd = std::make_unique<float[]>(n);
+    auto is_extended = std::make_unique<bool[]>(n);
+    map.GetMany(n, lon.data(), lat.data(), sd.get(), is_extended.get());
+
+    int n_diff = 0;
+    for (int k = 0; k < n; k++) {
+        auto [sd_1, ext_1] = map.Get(lon[k], lat[k]);
+        if (memcmp(&sd_1, &sd[k], sizeof(float)) != 0 || ext_1 != is_extended[k])
+            n_diff++;
+    }
+
+    LogMsg("%s: %d points, # of differing points: %d", what, n, n_diff);
+    return n_diff;
+}
+
+// native decoding of the golden input must match the wgrib2 path
+static bool
+golden_test()
+{
+    const std::string grib_file = "testdata/2023-12-03_12_noaa.grib2";
+
+    DepthMap native_map(0.25f), wgrib2_map(0.25f);
+    if (!native_map.LoadGrib(grib_file) || !LoadGribWgrib2(wgrib2_map, grib_file)) {
+        LogMsg("golden_test: can't load '%s'", grib_file.c_str());
+        return false;
+    }
+
+    if (compare_maps(native_map, wgrib2_map, "golden_test native vs. wgrib2") != 0
+        || compare_get_many(native_map, "golden_test GetMany() vs. Get()") != 0)
+        return false;
+
+    // snapshot round trip
+    const std::string snapshot_file = "golden_test.snod";
+    if (!native_map.SaveSnapshot(snapshot_file, grib_file))
+        return false;
+
+    auto snapshot_map = DepthMap::LoadSnapshot(snapshot_file, grib_file);
+    bool res = (snapshot_map != nullptr
+                && compare_maps(native_map, *snapshot_map, "golden_test native vs. snapshot") == 0
+                && DepthMap::LoadSnapshot(snapshot_file, "other source") == nullptr);
+    snapshot_map = nullptr;
+
+    // compact map and its snapshot
+    DepthMap compact_map(0.25f);
+    res = res && compact_map.LoadGrib(grib_file);
+    compact_map.Compact();
+    res = res && compare_maps(native_map, compact_map, "golden_test native vs. compact", 0.6e-3f) == 0
+          && compare_get_many(compact_map, "golden_test compact GetMany() vs. Get()") == 0
+          && compact_map.SaveSnapshot(snapshot_file, grib_file);
+    snapshot_map = DepthMap::LoadSnapshot(snapshot_file, grib_file);
+    res = res && snapshot_map != nullptr && snapshot_map->IsCompact()
+          && compare_maps(compact_map, *snapshot_map, "golden_test compact vs. snapshot") == 0;
+    snapshot_map = nullptr;
+
+    std::remove(snapshot_file.c_str());
+    return res;
+}
+
+// selective download of a message via the .idx inventory
+// By default the files are read through a file:// url,
+// set IDX_TEST_URL to e.g. "http://localhost:8000/" for a local http server serving the current directory.
+static bool
+idx_test()
+{
+    const std::string grib_file = "testdata/2023-12-03_12_noaa.grib2";
+
+    std::ifstream in(grib_file, std::ios::binary);
+    std::string msg((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (msg.empty()) {
+        LogMsg("idx_test: can't read '%s'", grib_file.c_str());
+        return false;
+    }
+
+    // 2 messages: the SNOD message is preceded by a (fake) TMP message
+    {
+        std::ofstream out("idx_test.grib2", std::ios::binary);
+        out << msg << msg;
+        std::ofstream idx("idx_test.grib2.idx", std::ios::binary);
+        idx << "1:0:d=2023120312:TMP:surface:6 hour fcst:\n"
+            << "2:" << msg.size() << ":d=2023120312:SNOD:surface:6 hour fcst:\n";
+    }
+
+    std::string base_url;
+    const char *url = std::getenv("IDX_TEST_URL");
+    if (url)
+        base_url = url;
+    else
+        base_url = "file://" + std::filesystem::current_path().generic_string() + "/";
+
+    const std::string out_file = "idx_test_out.grib2";
+    std::remove(out_file.c_str());
+    bool res = DownloadGribFileIdx(base_url + "idx_test.grib2", out_file, {"SNOD:surface"});
+    if (res) {
+        std::ifstream in(out_file, std::ios::binary);
+        std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        DepthMap map(0.25f);
+        res = (data == msg && map.LoadGrib(out_file));
+    }
+
+    // both messages are wanted, so they are merged into one range,
+    // a sub field of the 2nd one must not add it again
+    if (res) {
+        {
+            std::ofstream idx("idx_test.grib2.idx", std::ios::binary);
+            idx << "1:0:d=2023120312:TMP:surface:6 hour fcst:\n"
+                << "2:" << msg.size() << ":d=2023120312:SNOD:surface:6 hour fcst:\n"
+                << "2.1:" << msg.size() << ":d=2023120312:WEASD:surface:6 hour fcst:\n";
+        }
+
+        std::remove(out_file.c_str());
+        res = DownloadGribFileIdx(base_url + "idx_test.grib2", out_file,
+                                  {"TMP:surface", "SNOD:surface", "WEASD:surface"});
+        if (res) {
+            std::ifstream in(out_file, std::ios::binary);
+            std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+            res = (data == msg + msg);
+        }
+    }
+
+    LogMsg("idx_test: %s", res ? "ok" : "failed");
+    std::remove("idx_test.grib2");
+    std::remove("idx_test.grib2.idx");
+    std::remove(out_file.c_str());
+    return res;
+}
+
+// The coastal snow extension must give the same pinned result for any # of threads.
+// If the extension is changed on purpose, check the new map and update kExtendCrc.
+static bool
+extend_test()
+{
+    static constexpr uLong kExtendCrc = 0xadcb34cf;
+    const std::string grib_file = "testdata/2023-12-03_12_noaa.grib2";
+    if (!coast_map.is_loaded()) {
+        LogMsg("extend_test: no coast map");
+        return false;
+    }
+
+    // 1 thread is the serial path, 1000 threads give more bands than rows if not limited
+    bool res = true;
+    for (int n_threads : {1, 3, 8, 1000}) {
+        DepthMap::extend_threads_ = n_threads;
+        DepthMap map(0.25f);
+        if (!map.LoadGrib(grib_file)) {
+            res = false;
+            break;
+        }
+
+        // crc of all grid points
+        uLong crc = crc32(0L, Z_NULL, 0);
+        for (int j = 0; j < 721; j++)
+            for (int i = 0; i < 1440; i++) {
+                auto [sd, is_extended] = map.Get(i * 0.25f, j * 0.25f - 90.0f);
+                crc = crc32(crc, (const Bytef *)&sd, sizeof(sd));
+                crc = crc32(crc, (const Bytef *)&is_extended, sizeof(is_extended));
+            }
+
+        LogMsg("extend_test: %d threads, crc: 0x%08lx, expected: 0x%08lx", n_threads, crc, kExtendCrc);
+        res = res && (crc == kExtendCrc);
+    }
+
+    DepthMap::extend_threads_ = 0;
+    return res;
+}
+
 int main()
 {
     xp_dir = ".";
@@ -74,6 +292,15 @@ int main()
     probe_nearest_land(63.378151, -21.262616);  // Iceland
     probe_nearest_land(69.888846, 16.774953);   // Tromso
 
+    if (!golden_test())
+        return 1;
+
+    if (!extend_test())
+        return 1;
+
+    if (!idx_test())
+        return 1;
+
     StartAsyncDownload(true, 0, 0, 0);
     flightloop_emul();
 
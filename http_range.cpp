@@ -0,0 +1,187 @@
+//
+//    X Airline Snow: show accumulated snow in X-Plane's world
+//
+//    Copyright (C) 2025  Holger Teutsch
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+// HTTP GET of a byte range, xplib's HttpGet only fetches whole documents
+
+#include <cstdint>
+#include <string>
+
+#if IBM == 1
+#include <windows.h>
+#include <winhttp.h>
+#else
+#include <curl/curl.h>
+#endif
+
+#include "xa-snow.h"
+
+#if IBM == 1
+// close WinHTTP handles on scope exit
+struct WinHttpHandle {
+    HINTERNET h;
+    WinHttpHandle(HINTERNET h) : h(h) {}
+    ~WinHttpHandle() { if (h) WinHttpCloseHandle(h); }
+    operator HINTERNET() const { return h; }
+};
+
+// -> HTTP status or 0 on transport error
+static int
+GetRange(const std::string& url, const std::string& range, std::string& data, int timeout)
+{
+    std::wstring wurl(url.begin(), url.end());
+    wchar_t host[256], path[2048], extra[2048];
+
+    URL_COMPONENTS uc{};
+    uc.dwStructSize = sizeof(uc);
+    uc.lpszHostName = host;
+    uc.dwHostNameLength = sizeof(host) / sizeof(host[0]);
+    uc.lpszUrlPath = path;
+    uc.dwUrlPathLength = sizeof(path) / sizeof(path[0]);
+    uc.lpszExtraInfo = extra;
+    uc.dwExtraInfoLength = sizeof(extra) / sizeof(extra[0]);
+
+    if (!WinHttpCrackUrl(wurl.c_str(), 0, 0, &uc)) {
+        LogMsg("Can't parse url '%s'", url.c_str());
+        return 0;
+    }
+
+    WinHttpHandle session(WinHttpOpen(L"xa-snow", WINHTTP_ACCESS_TYPE_DEFAULT_PROXY,
+                                      WINHTTP_NO_PROXY_NAME, WINHTTP_NO_PROXY_BYPASS, 0));
+    if (!session)
+        return 0;
+
+    int timeout_ms = timeout * 1000;
+    WinHttpSetTimeouts(session, timeout_ms, timeout_ms, timeout_ms, timeout_ms);
+
+    WinHttpHandle connection(WinHttpConnect(session, host, uc.nPort, 0));
+    if (!connection)
+        return 0;
+
+    std::wstring object = std::wstring(path) + extra;
+    WinHttpHandle request(WinHttpOpenRequest(connection, L"GET", object.c_str(), NULL, WINHTTP_NO_REFERER,
+                                             WINHTTP_DEFAULT_ACCEPT_TYPES,
+                                             uc.nScheme == INTERNET_SCHEME_HTTPS ? WINHTTP_FLAG_SECURE : 0));
+    if (!request)
+        return 0;
+
+    std::wstring header = L"Range: bytes=" + std::wstring(range.begin(), range.end());
+    if (!WinHttpAddRequestHeaders(request, header.c_str(), (DWORD)-1L, WINHTTP_ADDREQ_FLAG_ADD)
+        || !WinHttpSendRequest(request, WINHTTP_NO_ADDITIONAL_HEADERS, 0, WINHTTP_NO_REQUEST_DATA, 0, 0, 0)
+        || !WinHttpReceiveResponse(request, NULL)) {
+        LogMsg("HTTP request failed: %lu", GetLastError());
+        return 0;
+    }
+
+    DWORD status = 0;
+    DWORD size = sizeof(status);
+    if (!WinHttpQueryHeaders(request, WINHTTP_QUERY_STATUS_CODE | WINHTTP_QUERY_FLAG_NUMBER,
+                             WINHTTP_HEADER_NAME_BY_INDEX, &status, &size, WINHTTP_NO_HEADER_INDEX))
+        return 0;
+
+    for (;;) {
+        DWORD avail = 0;
+        if (!WinHttpQueryDataAvailable(request, &avail))
+            return 0;
+
+        if (avail == 0)
+            break;
+
+        size_t ofs = data.size();
+        data.resize(ofs + avail);
+        DWORD n_read = 0;
+        if (!WinHttpReadData(request, data.data() + ofs, avail, &n_read))
+            return 0;
+        data.resize(ofs + n_read);
+    }
+
+    return status;
+}
+
+#else
+
+static size_t
+WriteCb(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+    ((std::string *)userdata)->append(ptr, size * nmemb);
+    return size * nmemb;
+}
+
+// -> HTTP status or 0 on transport error
+static int
+GetRange(const std::string& url, const std::string& range, std::string& data, int timeout)
+{
+    CURL *curl = curl_easy_init();
+    if (curl == nullptr)
+        return 0;
+
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_RANGE, range.c_str());
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, (long)timeout);
+    // abort if the transfer stalls
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, (long)timeout);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCb);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &data);
+
+    CURLcode res = curl_easy_perform(curl);
+    long status = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+    curl_easy_cleanup(curl);
+
+    if (res != CURLE_OK) {
+        LogMsg("HTTP request failed: %s", curl_easy_strerror(res));
+        return 0;
+    }
+
+    // file:// urls have no status
+    return (url.starts_with("file:") && status == 0) ? 206 : (int)status;
+}
+#endif
+
+// get bytes first..last (last < 0: up to the end) of url and append them to data
+// -> success
+bool
+HttpGetRange(const std::string& url, uint64_t first, int64_t last, std::string& data, int timeout)
+{
+    std::string range = std::to_string(first) + "-";
+    if (last >= 0)
+        range += std::to_string(last);
+
+    std::string chunk;
+    int status = GetRange(url, range, chunk, timeout);
+
+    if (status == 200) {
+        // server ignored the range, so we cut it out ourselves
+        if (chunk.size() <= first) {
+            LogMsg("range %s is beyond the end of '%s'", range.c_str(), url.c_str());
+            return false;
+        }
+
+        chunk = chunk.substr(first, last >= 0 ? last - first + 1 : std::string::npos);
+    } else if (status != 206) {
+        LogMsg("HTTP GET of range %s of '%s' failed, status: %d", range.c_str(), url.c_str(), status);
+        return false;
+    }
+
+    data.append(chunk);
+    return true;
+}
@@ -0,0 +1,90 @@
+//
+//    X Airline Snow: show accumulated snow in X-Plane's world
+//
+//    Copyright (C) 2025  Holger Teutsch
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+#include <bit>
+#include <algorithm>
+
+#include "xa-snow.h"
+#include "loop_stats.h"
+
+LoopStats loop_stats;
+
+// bucket b >= kSub holds [(kSub + sub) << shift, (kSub + sub + 1) << shift)
+// with shift = b / kSub - 1, sub = b % kSub
+int LoopHistogram::Bucket(uint64_t ns) {
+    if (ns < kSub)
+        return ns;
+
+    int shift = std::bit_width(ns) - 3;     // 3 = log2(kSub) + 1
+    int b = (shift + 1) * kSub + (int)((ns >> shift) - kSub);
+    return std::min(b, kNBuckets - 1);
+}
+
+uint64_t LoopHistogram::BucketMax(int b) {
+    if (b < kSub)
+        return b;
+
+    int shift = b / kSub - 1;
+    return ((uint64_t)(kSub + b % kSub + 1) << shift) - 1;
+}
+
+void LoopHistogram::Add(uint64_t ns) {
+    bucket_[Bucket(ns)]++;
+    n_++;
+    sum_ns_ += ns;
+    max_ns_ = std::max(max_ns_, ns);
+}
+
+uint64_t LoopHistogram::Percentile(double p) const {
+    if (n_ == 0)
+        return 0;
+
+    // the smallest value with at least p * n samples <= value
+    uint64_t rank = std::max<uint64_t>(1, (uint64_t)(p * n_ + 0.5));
+    uint64_t cnt = 0;
+    for (int b = 0; b < kNBuckets; b++) {
+        cnt += bucket_[b];
+        if (cnt >= rank)
+            return std::min(BucketMax(b), max_ns_);
+    }
+
+    return max_ns_;
+}
+
+void LoopStats::Log() {
+    if (hist_[kTotal].n() == 0)
+        return;
+
+    double secs = std::chrono::duration<double>(Clock::now() - window_start_).count();
+    LogMsg("Flight loop stats for the last %0.0f s, full: %llu, throttled: %llu frames", secs,
+           (unsigned long long)n_full_, (unsigned long long)n_throttled_);
+    for (int s = 0; s < kNSections; s++) {
+        const LoopHistogram& h = hist_[s];
+        LogMsg("  %-8s n: %7llu, mean: %7.2f, p50: %7.2f, p99: %7.2f, max: %8.2f us", kSectionName[s],
+               (unsigned long long)h.n(), h.mean_ns() * 1.0e-3, h.Percentile(0.5) * 1.0e-3,
+               h.Percentile(0.99) * 1.0e-3, h.max_ns() * 1.0e-3);
+    }
+
+    for (auto& h : hist_)
+        h.Reset();
+    n_full_ = n_throttled_ = 0;
+    window_start_ = Clock::now();
+}
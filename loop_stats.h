@@ -0,0 +1,80 @@
+//
+//    X Airline Snow: show accumulated snow in X-Plane's world
+//
+//    Copyright (C) 2025  Holger Teutsch
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+#ifndef _LOOP_STATS_H_
+#define _LOOP_STATS_H_
+
+#include <cstdint>
+#include <chrono>
+
+// Histogram of durations in ns, log-linear: 4 buckets per power of 2, so a percentile
+// is off by at most 1/4 of its value. Adding a sample is a few instructions.
+class LoopHistogram {
+    static constexpr int kSub = 4;
+    static constexpr int kNBuckets = 40 * kSub;     // up to ~ 1000 s
+
+    uint32_t bucket_[kNBuckets]{};
+    uint64_t n_{0};
+    uint64_t sum_ns_{0};
+    uint64_t max_ns_{0};
+
+    static int Bucket(uint64_t ns);
+    static uint64_t BucketMax(int b);       // largest ns that goes into bucket b
+
+  public:
+    void Add(uint64_t ns);
+    void Reset() { *this = LoopHistogram(); }
+
+    uint64_t n() const { return n_; }
+    uint64_t max_ns() const { return max_ns_; }
+    double mean_ns() const { return n_ > 0 ? (double)sum_ns_ / n_ : 0.0; }
+    uint64_t Percentile(double p) const;    // p in [0, 1], -> ns
+};
+
+// Timing of the flight loop by section.
+// The numbers are for the window since the last Log().
+struct LoopStats {
+    enum Section { kTotal, kCompute, kProbe, kDrefs, kNSections };
+    static constexpr const char *kSectionName[kNSections] = {"total", "compute", "probe", "drefs"};
+
+    using Clock = std::chrono::steady_clock;
+
+    LoopHistogram hist_[kNSections];
+    uint64_t n_full_{0};            // frames with the throttled computations
+    uint64_t n_throttled_{0};       // frames without
+    Clock::time_point window_start_{Clock::now()};
+
+    // times a section of code
+    class Timer {
+        LoopHistogram& hist_;
+        Clock::time_point start_{Clock::now()};
+
+      public:
+        Timer(LoopStats& stats, Section s) : hist_(stats.hist_[s]) {}
+        Timer(const Timer&) = delete;
+        ~Timer() { hist_.Add(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_).count()); }
+    };
+
+    void Log();                     // and start a new window
+};
+
+extern LoopStats loop_stats;
+#endif
@@ -110,7 +110,7 @@ MapTexture::set_bounds(const float *ltrb, XPLMMapProjectionID projection)
 bool
 MapTexture::check_image()
 {
-    if (snod_map == nullptr)
+    if (!InitDone() || snod_map == nullptr)
         return false;
 
     if (snod_seqno_ != snod_map->SeqNo())   // have map of stale revision
@@ -135,12 +135,25 @@ MapTexture::check_image()
 
     std::unique_ptr<Pixel[]> data = std::make_unique<Pixel[]>(width * height);
 
+    // sample row by row
+    auto lon_row = std::make_unique<float[]>(width);
+    auto lat_row = std::make_unique<float[]>(width);
+    auto sd_row = std::make_unique<float[]>(width);
+    auto is_extended_row = std::make_unique<bool[]>(width);
+
+    for (int i = 0; i < width; i++)
+        lon_row[i] = (i == 0) ? left_lon_ : lon_row[i - 1] + dll;
+
     int pix_idx = 0;
     float lat = bottom_lat_;
     for (int j = 0; j < height; j++) {
-        float lon = left_lon_;
+        std::fill_n(lat_row.get(), width, lat);
+        snod_map->GetMany(width, lon_row.get(), lat_row.get(), sd_row.get(), is_extended_row.get());
+
         for (int i = 0; i < width; i++) {
-            auto [sd, is_extended] = snod_map->Get(lon, lat);
+            float lon = lon_row[i];
+            float sd = sd_row[i];
+            bool is_extended = is_extended_row[i];
             //LogMsg("(%d, %d), sd: %0.3f", i, j, sd);
 
             bool is_coast = false;
@@ -171,7 +184,6 @@ MapTexture::check_image()
                 //LogMsg("pix_idx: %d, pixel: %08x", pix_idx, pixel);
                 data[pix_idx] = pixel;
             }
-            lon += dll;
             pix_idx++;
         }
         lat += dll;
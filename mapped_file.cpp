@@ -0,0 +1,112 @@
+//
+//    X Airline Snow: show accumulated snow in X-Plane's world
+//
+//    Copyright (C) 2025  Holger Teutsch
+//
+//    This library is free software; you can redistribute it and/or
+//    modify it under the terms of the GNU Lesser General Public
+//    License as published by the Free Software Foundation; either
+//    version 2.1 of the License, or (at your option) any later version.
+//
+//    This library is distributed in the hope that it will be useful,
+//    but WITHOUT ANY WARRANTY; without even the implied warranty of
+//    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+//    Lesser General Public License for more details.
+//
+//    You should have received a copy of the GNU Lesser General Public
+//    License along with this library; if not, write to the Free Software
+//    Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+//    USA
+//
+
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "xa-snow.h"
+#include "mapped_file.h"
+
+bool
+MappedFile::Open(const std::string& path)
+{
+    Close();
+
+#ifdef _WIN32
+    HANDLE fh = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fh == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(fh, &size) || size.QuadPart == 0) {
+        CloseHandle(fh);
+        return false;
+    }
+
+    // the mapping keeps the file open
+    HANDLE mh = CreateFileMappingA(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(fh);
+    if (mh == NULL) {
+        LogMsg("CreateFileMapping failed for '%s': %lu", path.c_str(), GetLastError());
+        return false;
+    }
+
+    void *p = MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+    if (p == NULL) {
+        LogMsg("MapViewOfFile failed for '%s': %lu", path.c_str(), GetLastError());
+        CloseHandle(mh);
+        return false;
+    }
+
+    mapping_ = mh;
+    size_ = size.QuadPart;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    // the mapping keeps the file open
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        LogMsg("mmap failed for '%s'", path.c_str());
+        return false;
+    }
+
+    size_ = st.st_size;
+#endif
+
+    data_ = (const uint8_t *)p;
+    return true;
+}
+
+void
+MappedFile::Close()
+{
+    if (data_ == nullptr)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(data_);
+    CloseHandle((HANDLE)mapping_);
+    mapping_ = nullptr;
+#else
+    munmap((void *)data_, size_);
+#endif
+
+    data_ = nullptr;
+    size_ = 0;
+}
@@ -21,6 +21,7 @@
 
 #include <string>
 #include <cstdlib>
+#include <memory>
 #ifdef _WIN32
 #include <windows.h>
 #include <system_error>
@@ -28,11 +29,16 @@
 
 #include "xa-snow.h"
 
+// run command and pass its stdout in chunks to consumer
+// Windows: stderr is merged into stdout if requested otherwise it's dropped
+// Unix: stderr is inherited
 // returns 0 on success, != 0 some exit code
-int
-sub_exec(const std::string& command)
+static int
+sub_exec_impl(const std::string& command, const SubExecConsumer& consumer, [[maybe_unused]] bool merge_stderr)
 {
-    std::string output;
+    // large chunks as we may stream MBs through here
+    static constexpr int kChunkSize = 64 * 1024;
+    auto buffer = std::make_unique<char[]>(kChunkSize);
 
 #ifdef _WIN32
     std::error_code ec;
@@ -66,8 +72,12 @@ sub_exec(const std::string& command)
         return -1;
     }
 
+    HANDLE hNul = INVALID_HANDLE_VALUE;
+    if (!merge_stderr)
+        hNul = CreateFile("NUL", GENERIC_WRITE, FILE_SHARE_WRITE, &security_attributes, OPEN_EXISTING, 0, NULL);
+
     si.hStdOutput = hStdOutWrite;
-    si.hStdError = hStdOutWrite;
+    si.hStdError = merge_stderr ? hStdOutWrite : hNul;
 
     // Start the child process.
     if (!CreateProcess(NULL,
@@ -85,18 +95,20 @@ sub_exec(const std::string& command)
         ec = std::error_code(GetLastError(), std::system_category());
         CloseHandle(hStdOutWrite);
         CloseHandle(hStdOutRead);
+        if (hNul != INVALID_HANDLE_VALUE)
+            CloseHandle(hNul);
         return -1;
     }
 
     // Close handles to the child's STDOUT and stdin.
     CloseHandle(hStdOutWrite);
+    if (hNul != INVALID_HANDLE_VALUE)
+        CloseHandle(hNul);
 
     // Read from pipe and invoke callback.
-    char buffer[256];
     DWORD readBytes;
-    while (ReadFile(hStdOutRead, buffer, sizeof(buffer) - 1, &readBytes, NULL) && readBytes > 0) {
-        buffer[readBytes] = '\0';
-        output += buffer;
+    while (ReadFile(hStdOutRead, buffer.get(), kChunkSize, &readBytes, NULL) && readBytes > 0) {
+        consumer(buffer.get(), readBytes);
     }
 
     // Close remaining handles.
@@ -114,33 +126,49 @@ sub_exec(const std::string& command)
     CloseHandle(pi.hProcess);
 
     ec.clear();
-    if (exit_code != 0)
-        LogMsg("sub_exec output: '%s', exit_code: %ld", output.c_str(), exit_code);
-
     return exit_code;
 
 #else
-    int exit_code = 0;
-    // For Unix-like systems
-    char buffer[512];
-
     FILE* pipe = popen(command.c_str(), "r");
     if (!pipe) {
         LogMsg("popen() failed!");
         return 1;
     }
 
-    while (fgets(buffer, sizeof(buffer), pipe) != nullptr) {
-        output += buffer;
+    size_t n;
+    while ((n = fread(buffer.get(), 1, kChunkSize, pipe)) > 0) {
+        consumer(buffer.get(), n);
     }
 
-    exit_code = pclose(pipe);
+    return pclose(pipe);
+#endif
+}
+
+// returns 0 on success, != 0 some exit code
+int
+sub_exec(const std::string& command)
+{
+    std::string output;
 
+    int exit_code = sub_exec_impl(command,
+                                  [&output] (const char *data, size_t len) { output.append(data, len); },
+                                  true);
     if (exit_code != 0)
         LogMsg("sub_exec output: '%s', exit_code: %d", output.c_str(), exit_code);
 
     return exit_code;
-#endif
+}
+
+// stream stdout of command into consumer
+// returns 0 on success, != 0 some exit code
+int
+sub_exec(const std::string& command, const SubExecConsumer& consumer)
+{
+    int exit_code = sub_exec_impl(command, consumer, false);
+    if (exit_code != 0)
+        LogMsg("sub_exec exit_code: %d", exit_code);
+
+    return exit_code;
 }
 
 #if 0
@@ -29,6 +29,8 @@
 #include <filesystem>
 #include <array>
 #include <thread>
+#include <future>
+#include <chrono>
 
 #include "xa-snow.h"
 
@@ -40,6 +42,8 @@
 #include "airport.h"
 #include "depth_map.h"
 #include "coast_map.h"
+#include "loop_stats.h"
+#include "dref_writer.h"
 
 #include "version.h"
 
@@ -51,9 +55,15 @@ XPLMProbeInfo_t probeinfo;
 XPLMProbeRef probe_ref;
 
 static XPLMDataRef weather_mode_dr, rwy_cond_dr, sys_time_dr,
-    sim_current_month_dr, sim_current_day_dr, sim_local_hours_dr,
+    sim_current_month_dr, sim_current_day_dr, sim_local_hours_dr, sim_local_minutes_dr,
     snow_dr, ice_dr, rwy_snow_dr, framerate_period_dr, msl_temperature_dr;
 
+// Most frames don't change the snow datarefs measurably, a write is a call into X-Plane's accessor
+// and maybe other plugins, so skip these. X-Plane's weather may change them on its own, hence the refresh.
+// The runway friction is a clamp of the sim's value, so any difference is written.
+static DrefWriter snow_w(XPLMSetDataf, 1.0e-4f, 0.1, 1.0), ice_w(XPLMSetDataf, 1.0e-4f, 0.1, 1.0),
+    rwy_snow_w(XPLMSetDataf, 1.0e-4f, 0.1, 1.0), rwy_cond_w(XPLMSetDataf, 0.0f, 0.0, 1.0);
+
 static XPLMMenuID xas_menu;
 
 static bool private_drefs_inited;
@@ -73,6 +83,46 @@ static int override_item, no_rwy_ice_item, historical_item, autoupdate_item, tem
 
 static int loop_cnt;
 
+// background initialization
+static std::future<void> init_future;
+static bool init_done;
+
+using Clock = std::chrono::steady_clock;
+
+static double MsSince(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// -> s, for the DrefWriters
+static double Now() {
+    return std::chrono::duration<double>(Clock::now().time_since_epoch()).count();
+}
+
+static void AsyncInit(Clock::time_point plugin_start) {
+    LogMsg("Background init started at +%0.1f ms", MsSince(plugin_start));
+
+    auto start = Clock::now();
+    CollectAirports(xp_dir);
+    LogMsg("Startup trace: CollectAirports() %0.1f ms", MsSince(start));
+
+    start = Clock::now();
+    coast_map.load(plugin_dir);
+    LogMsg("Startup trace: coast_map.load() %0.1f ms", MsSince(start));
+
+    LogMsg("Background init done at +%0.1f ms", MsSince(plugin_start));
+}
+
+// -> legacy airports and coast map are available
+bool InitDone() {
+    if (!init_done && init_future.valid()
+        && std::future_status::ready == init_future.wait_for(std::chrono::seconds::zero())) {
+        init_future.get();
+        init_done = true;
+    }
+
+    return init_done;
+}
+
 std::tuple<float, float, float> SnowDepthToXplaneSnowNow(float depth) { // snowNow, snowAreaWidth, iceNow
     float snow_now_value = snow_now_0;
     float ice_now_value = ice_now_0;
@@ -172,17 +222,56 @@ static bool InitPrivateDrefs() {
             LogMsg("Could not map required private datarefs");
             return false;
         }
+
+        snow_w.set_dref(snow_dr);
+        ice_w.set_dref(ice_dr);
+        rwy_snow_w.set_dref(rwy_snow_dr);
     }
 
     return true;
 }
 
+// -> sys_time, month, day, hour, minute to get snow for
+static std::tuple<bool, int, int, int, int> SnowTime() {
+    if (!pref_historical)
+        return {true, 0, 0, 0, 0};
+
+    bool sys_time = (XPLMGetDatai(sys_time_dr) == 1);
+    int day = XPLMGetDatai(sim_current_day_dr);
+    int month = XPLMGetDatai(sim_current_month_dr);
+    int hour = XPLMGetDatai(sim_local_hours_dr);
+    int minute = XPLMGetDatai(sim_local_minutes_dr);
+    return {sys_time, month, day, hour, minute};
+}
+
+// and start a new window
+static void LogLoopStats() {
+    if (loop_stats.hist_[LoopStats::kTotal].n() == 0)
+        return;
+
+    loop_stats.Log();
+    LogMsg("  dataref writes: %llu, suppressed: %llu", (unsigned long long)DrefWriter::n_written_,
+           (unsigned long long)DrefWriter::n_suppressed_);
+    DrefWriter::n_written_ = DrefWriter::n_suppressed_ = 0;
+}
+
 static float FlightLoopCb([[maybe_unused]] float inElapsedSinceLastCall,
                           [[maybe_unused]] float inElapsedTimeSinceLastFlightLoop, [[maybe_unused]] int inCounter,
                           [[maybe_unused]] void* inRefcon) {
     static float snow_depth_n, snow_depth_prev, snow_now, rwy_snow, ice_now, alpha, ground_temperature;
     static bool legacy_airport_range, is_extended_snow;
     static constexpr float es_temp_threshold = 3.0f;  // °C, above this we assume reduced snow depth for extended snow
+    static constexpr auto stats_interval = std::chrono::minutes(5);
+
+    LoopStats::Timer t_total(loop_stats, LoopStats::kTotal);
+    if (Clock::now() - loop_stats.window_start_ > stats_interval)
+        LogLoopStats();
+
+    // everything below needs the airports and the coast map
+    if (!InitDone()) {
+        LogMsg("... waiting for background init");
+        return 1.0f;
+    }
 
     if (loop_cnt == 0) {
         loop_cnt++;
@@ -194,20 +283,14 @@ static float FlightLoopCb([[maybe_unused]] float inElapsedSinceLastCall,
         // We may come here after a move to a different airport, so
         // XP 12.4.0+ private datarefs need to be reset
         if (private_drefs_inited) {
-            XPLMSetDataf(snow_dr, snow_now_0);
-            XPLMSetDataf(ice_dr, ice_now_0);
-            XPLMSetDataf(rwy_snow_dr, snow_area_width_0);
+            double now = Now();
+            snow_w.Write(snow_now_0, now);
+            ice_w.Write(ice_now_0, now);
+            rwy_snow_w.Write(snow_area_width_0, now);
         }
 
-        if (!pref_historical)
-            StartAsyncDownload(true, 0, 0, 0);
-        else {
-            bool sys_time = (XPLMGetDatai(sys_time_dr) == 1);
-            int day = XPLMGetDatai(sim_current_day_dr);
-            int month = XPLMGetDatai(sim_current_month_dr);
-            int hour = XPLMGetDatai(sim_local_hours_dr);
-            StartAsyncDownload(sys_time, month, day, hour);
-        }
+        auto [sys_time, month, day, hour, minute] = SnowTime();
+        StartAsyncDownload(sys_time, month, day, hour);
 
         // set to known "no snow" values
         snow_depth = 0.0f;
@@ -223,6 +306,13 @@ static float FlightLoopCb([[maybe_unused]] float inElapsedSinceLastCall,
         return 5.0f;
 
     loop_cnt++;
+
+    // follow the sim clock through the forecast steps
+    if (loop_cnt % 512 == 0) {
+        auto [sys_time, month, day, hour, minute] = SnowTime();
+        ScheduleGribDownload(sys_time, month, day, hour, minute);
+    }
+
     if (snod_map == nullptr) {
         LogMsg("... waiting for snow map");
         return 1.0f;
@@ -230,18 +320,26 @@ static float FlightLoopCb([[maybe_unused]] float inElapsedSinceLastCall,
 
     // throttle computations
     if (loop_cnt % 8 == 0) {
+        LoopStats::Timer t_compute(loop_stats, LoopStats::kCompute);
+        loop_stats.n_full_++;
         float lon = XPLMGetDataf(plane_lon_dr);
         float lat = XPLMGetDataf(plane_lat_dr);
 
-        std::tie(snow_depth_n, is_extended_snow) = snod_map->Get(lon, lat);
+        std::tie(snow_depth_n, is_extended_snow) = GetSnowDepth(lon, lat);
         std::tie(snow_depth_n, legacy_airport_range) = LegacyAirportSnowDepth(lon, lat, snow_depth_n);
 
+        coast_map.update_tiles(lon, lat);
+        {
+            LoopStats::Timer t_probe(loop_stats, LoopStats::kProbe);
+            ProbeAirports(lon, lat);
+        }
+
         if (!legacy_airport_range) {
             // do "over water close to coast" processing
             auto [is_water, have_nl, nl_lon, nl_lat] = coast_map.nearest_land(lon, lat);
             if (is_water && have_nl) {
                 float snow_depth_n1;
-                std::tie(snow_depth_n1, is_extended_snow) = snod_map->Get(nl_lon, nl_lat);
+                std::tie(snow_depth_n1, is_extended_snow) = GetSnowDepth(nl_lon, nl_lat);
                 // LogMsg("nl snow: %0.2f", snow_depth_n1);
                 snow_depth_n = std::max(snow_depth_n, snow_depth_n1);
             }
@@ -274,8 +372,10 @@ static float FlightLoopCb([[maybe_unused]] float inElapsedSinceLastCall,
         alpha = XPLMGetDataf(framerate_period_dr) / decay_time;
         snow_depth = alpha * snow_depth_n + (1 - alpha) * snow_depth;
         std::tie(snow_now, rwy_snow, ice_now) = SnowDepthToXplaneSnowNow(snow_depth);
-    } else
+    } else {
+        loop_stats.n_throttled_++;
         snow_depth = alpha * snow_depth_n + (1 - alpha) * snow_depth;
+    }
 
     // If we don't have accumulated snow leave the datarefs alone and
     // let X-Plane do its weather effect things
@@ -284,9 +384,10 @@ static float FlightLoopCb([[maybe_unused]] float inElapsedSinceLastCall,
         // the datarefs alone
         if (snow_depth_prev >= 0.001f) {
             LogMsg("Snow depth now zero, resetting datarefs");
-            XPLMSetDataf(snow_dr, snow_now_0);
-            XPLMSetDataf(rwy_snow_dr, snow_area_width_0);
-            XPLMSetDataf(ice_dr, ice_now_0);
+            double now = Now();
+            snow_w.Write(snow_now_0, now);
+            rwy_snow_w.Write(snow_area_width_0, now);
+            ice_w.Write(ice_now_0, now);
         }
 
         snow_depth_prev = snow_depth;
@@ -298,7 +399,9 @@ static float FlightLoopCb([[maybe_unused]] float inElapsedSinceLastCall,
     // Runway condition (=friction) is controlled by X-Plane's weather evolution (precipitation?)
     // and not directly by setting the snow/ice-related datarefs.
     // Therefore in case of no_rwy_ice we just clamp values to some minimal effects.
-    float rwy_cond = XPLMGetDataf(rwy_cond_dr);
+    LoopStats::Timer t_drefs(loop_stats, LoopStats::kDrefs);
+    float current_rwy_cond = XPLMGetDataf(rwy_cond_dr);
+    float rwy_cond = current_rwy_cond;
 
     if (pref_no_rwy_ice) {
         ice_now = std::min(ice_now, ice_now_tab[1]);   // some minimal ice effect
@@ -306,10 +409,11 @@ static float FlightLoopCb([[maybe_unused]] float inElapsedSinceLastCall,
         rwy_cond = std::min(rwy_cond, 6.0f);    // 6 = last below snow/ice effect
     }
 
-    XPLMSetDataf(snow_dr, snow_now);
-    XPLMSetDataf(rwy_snow_dr, rwy_snow);
-    XPLMSetDataf(ice_dr, ice_now);
-    XPLMSetDataf(rwy_cond_dr, rwy_cond);
+    double now = Now();
+    snow_w.Set(snow_now, now);
+    rwy_snow_w.Set(rwy_snow, now);
+    ice_w.Set(ice_now, now);
+    rwy_cond_w.Set(rwy_cond, current_rwy_cond, now);
 
 #if 0
     LogMsg("Snow depth: %0.2f m, snow_now: %0.3f, rwy_snow: %0.3f, ice_now: %0.3f, rwy_cond: %0.3f",
@@ -322,8 +426,24 @@ static float SnowDepthAcc([[maybe_unused]] void* ref) {
     return snow_depth;
 }
 
+// ref = section * 3 + stat
+static float LoopStatsAcc(void* ref) {
+    int section = (intptr_t)ref / 3;
+    const LoopHistogram& h = loop_stats.hist_[section];
+    switch ((intptr_t)ref % 3) {
+        case 0: return h.Percentile(0.5) * 1.0e-3f;
+        case 1: return h.Percentile(0.99) * 1.0e-3f;
+        default: return h.max_ns() * 1.0e-3f;
+    }
+}
+
+static int LoopCountAcc(void* ref) {
+    return *(uint64_t *)ref;
+}
+
 // =========================== plugin entry points ===============================================
 PLUGIN_API int XPluginStart(char* out_name, char* out_sig, char* out_desc) {
+    auto plugin_start = Clock::now();
     LogMsg("Startup " VERSION);
 
     strcpy(out_name, "X Airline Snow - " VERSION);
@@ -355,11 +475,13 @@ PLUGIN_API int XPluginStart(char* out_name, char* out_sig, char* out_desc) {
 
     weather_mode_dr = XPLMFindDataRef("sim/weather/region/weather_source");
     rwy_cond_dr = XPLMFindDataRef("sim/weather/region/runway_friction");
+    rwy_cond_w.set_dref(rwy_cond_dr);
 
     sys_time_dr = XPLMFindDataRef("sim/time/use_system_time");
     sim_current_month_dr = XPLMFindDataRef("sim/cockpit2/clock_timer/current_month");
     sim_current_day_dr = XPLMFindDataRef("sim/cockpit2/clock_timer/current_day");
     sim_local_hours_dr = XPLMFindDataRef("sim/cockpit2/clock_timer/local_time_hours");
+    sim_local_minutes_dr = XPLMFindDataRef("sim/cockpit2/clock_timer/local_time_minutes");
     framerate_period_dr = XPLMFindDataRef("sim/time/framerate_period");
 
     msl_temperature_dr = XPLMFindDataRef("sim/weather/temperature_sealevel_c");
@@ -367,9 +489,8 @@ PLUGIN_API int XPluginStart(char* out_name, char* out_sig, char* out_desc) {
     probeinfo.structSize = sizeof(XPLMProbeInfo_t);
     probe_ref = XPLMCreateProbe(xplm_ProbeY);
 
-    CollectAirports(xp_dir);
-
-    coast_map.load(plugin_dir);
+    // the slow parts run in the background, the flight loop and the map layer wait for them
+    init_future = std::async(std::launch::async, AsyncInit, plugin_start);
 
     // build menues
     XPLMMenuID menu = XPLMFindPluginsMenu();
@@ -393,6 +514,25 @@ PLUGIN_API int XPluginStart(char* out_name, char* out_sig, char* out_desc) {
     XPLMRegisterDataAccessor("xa-snow/snow_depth", xplmType_Float, 0, NULL, NULL, SnowDepthAcc, NULL, NULL, NULL,
                              NULL, NULL, NULL, NULL, NULL, NULL, NULL, 0);
 
+    // flight loop timing in us, since the last dump to Log.txt
+    for (int s = 0; s < LoopStats::kNSections; s++) {
+        static const char *stat_name[] = {"p50_us", "p99_us", "max_us"};
+        for (int k = 0; k < 3; k++) {
+            std::string name = std::string("xa-snow/perf/") + LoopStats::kSectionName[s] + "/" + stat_name[k];
+            XPLMRegisterDataAccessor(name.c_str(), xplmType_Float, 0, NULL, NULL, LoopStatsAcc, NULL, NULL, NULL,
+                                     NULL, NULL, NULL, NULL, NULL, NULL, (void*)(intptr_t)(s * 3 + k), 0);
+        }
+    }
+
+    XPLMRegisterDataAccessor("xa-snow/perf/n_full", xplmType_Int, 0, LoopCountAcc, NULL, NULL, NULL, NULL, NULL,
+                             NULL, NULL, NULL, NULL, NULL, NULL, &loop_stats.n_full_, 0);
+    XPLMRegisterDataAccessor("xa-snow/perf/n_throttled", xplmType_Int, 0, LoopCountAcc, NULL, NULL, NULL, NULL,
+                             NULL, NULL, NULL, NULL, NULL, NULL, NULL, &loop_stats.n_throttled_, 0);
+    XPLMRegisterDataAccessor("xa-snow/perf/n_dref_writes", xplmType_Int, 0, LoopCountAcc, NULL, NULL, NULL, NULL,
+                             NULL, NULL, NULL, NULL, NULL, NULL, NULL, &DrefWriter::n_written_, 0);
+    XPLMRegisterDataAccessor("xa-snow/perf/n_dref_suppressed", xplmType_Int, 0, LoopCountAcc, NULL, NULL, NULL,
+                             NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, &DrefWriter::n_suppressed_, 0);
+
     LogMsg("XPluginStart done, xp_dir: '%s'", xp_dir.c_str());
 
     // set 0 values for various reset operations
@@ -406,12 +546,21 @@ PLUGIN_API int XPluginStart(char* out_name, char* out_sig, char* out_desc) {
 
     // ... and off we go
     XPLMRegisterFlightLoopCallback(FlightLoopCb, 2.0, NULL);
+    LogMsg("Startup trace: XPluginStart() %0.1f ms", MsSince(plugin_start));
     return 1;
 }
 
 PLUGIN_API void XPluginStop(void) {
     MapLayerStopHook();
 
+    if (init_future.valid()) {
+        LogMsg("... waiting for background init to finish");
+        init_future.wait();
+    }
+
+    SaveAirportsCache();
+    coast_map.wait_tiles();
+
     // As an async can not be cancelled we have to wait
     // and collect the status. Otherwise X Plane won't shut down.
     while (CheckAsyncDownload()) {
@@ -428,14 +577,16 @@ PLUGIN_API int XPluginEnable(void) {
 
 PLUGIN_API void XPluginDisable(void) {
     SavePrefs();
-    snod_map = nullptr;
+    LogLoopStats();
+    ResetSnowMaps();
     MapLayerDisableHook();
 
     // XP 12.4.x private datarefs need to be reset on disable
     if (private_drefs_inited) {
-        XPLMSetDataf(snow_dr, snow_now_0);
-        XPLMSetDataf(ice_dr, ice_now_0);
-        XPLMSetDataf(rwy_snow_dr, snow_area_width_0);
+        double now = Now();
+        snow_w.Write(snow_now_0, now);
+        ice_w.Write(ice_now_0, now);
+        rwy_snow_w.Write(snow_area_width_0, now);
     }
 }
 
@@ -28,6 +28,12 @@
 #include <tuple>
 #include <numbers>
 #include <memory>
+#include <vector>
+#include <functional>
+#include <string_view>
+#include <charconv>
+#include <cstring>
+#include <cstdlib>
 
 #include "XPLMDataAccess.h"
 #include "XPLMScenery.h"
@@ -38,6 +44,7 @@
 static constexpr float kD2R = std::numbers::pi/180.0;
 static constexpr float kLat2m = 111120;                 // 1° lat in m
 static constexpr float kF2M = 0.3048;                   // 1 ft [m]
+static constexpr float kSnodResolution = 0.25f;         // of GFS's snow depth maps
 
 extern XPLMDataRef plane_lat_dr, plane_lon_dr, plane_elevation_dr, plane_y_agl_dr;
 
@@ -48,16 +55,55 @@ extern std::string xp_dir;
 extern std::string plugin_dir;
 extern std::string output_dir;
 
+// Parse a number that fills all of w, locale independent.
+// Via double as atof() did, so the results are the same to the last bit.
+// -> success
+static inline bool ToFloat(std::string_view w, float& value) {
+    double d;
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    auto [ptr, ec] = std::from_chars(w.data(), w.data() + w.size(), d);
+    if (ec != std::errc() || ptr != w.data() + w.size())
+        return false;
+#else
+    // e.g. Apple's libc++ has no from_chars for floating point
+    char buf[32];
+    if (w.empty() || w.size() >= sizeof(buf))
+        return false;
+    memcpy(buf, w.data(), w.size());
+    buf[w.size()] = '\0';
+    char *ptr;
+    d = strtod(buf, &ptr);
+    if (ptr != buf + w.size())
+        return false;
+#endif
+    value = d;
+    return true;
+}
+
 // functions
 extern "C" bool HttpGet(const char *url, FILE *f, int timeout);
+extern bool HttpGetRange(const std::string& url, uint64_t first, int64_t last, std::string& data, int timeout);
 extern int sub_exec(const std::string& command);
 
-void StartAsyncDownload(bool sys_time, int day, int month, int hour);
+using SubExecConsumer = std::function<void(const char *data, size_t len)>;
+extern int sub_exec(const std::string& command, const SubExecConsumer& consumer);
+
+// legacy airports and coast map are loaded in the background
+bool InitDone();
+
+void StartAsyncDownload(bool sys_time, int month, int day, int hour);
+void ScheduleGribDownload(bool sys_time, int month, int day, int hour, int minute);
 bool CheckAsyncDownload();
+void ResetSnowMaps();   // the current and the prefetched one
 
 class DepthMap;
 
+extern bool LoadGribWgrib2(DepthMap& map, const std::string& grib_file_path);
+extern bool DownloadGribFileIdx(const std::string& grib_url, const std::string& grib_file_path,
+                                const std::vector<std::string>& fields);
+
 extern std::unique_ptr<DepthMap> snod_map, new_snod_map;
+extern std::tuple<float, bool> GetSnowDepth(float lon, float lat);     // snow depth, is_extended
 extern std::tuple<float, float, float> SnowDepthToXplaneSnowNow(float depth); // snowNow, snowAreaWidth, iceNow
 
 // -> 0 = success